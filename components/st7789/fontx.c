@@ -4,8 +4,10 @@
 #include <string.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
+#ifdef ESP_PLATFORM
 #include "esp_err.h"
 #include "esp_log.h"
+#endif
 //#include "esp_spiffs.h"
 
 #include "fontx.h"
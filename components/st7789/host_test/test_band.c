@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "st7789.h"
+#include "st7796s_emu.h"
+
+// Draw the same calls with band rendering and straight to a second panel,
+// then compare the two GRAMs. Built with CONFIG_BAND_RENDERING, see Makefile.
+
+#define FONT "../../../font/ILGH32XB.FNT"
+
+static int failures = 0;
+
+static void compare(EMU_t * band, EMU_t * direct, int width, int height, const char * name)
+{
+	int bad = 0;
+	for (int y=0;y<height;y++) {
+		for (int x=0;x<width;x++) {
+			if (emuGetPixel(band, x, y) == emuGetPixel(direct, x, y)) continue;
+			if (bad++ == 0) printf("%s: (%d,%d) is %04x, expected %04x\n", name, x, y, emuGetPixel(band, x, y), emuGetPixel(direct, x, y));
+		}
+	}
+	if (bad) {
+		printf("%s: %d pixels differ\n", name, bad);
+		failures++;
+	}
+}
+
+typedef void (*draw_t)(TFT_t * dev, FontxFile * fx, int width, int height);
+
+static void run(const char * name, draw_t draw, FontxFile * fx, int width, int height)
+{
+	TFT_t band, direct;
+	EMU_t eband, edirect;
+	memset(&band, 0, sizeof(band));
+	memset(&direct, 0, sizeof(direct));
+	emuInit(&band, &eband, width, height);
+	emuInit(&direct, &edirect, width, height);
+	lcdInit(&band, width, height, 0, 0);
+	lcdInit(&direct, width, height, 0, 0);
+	if (band._band == NULL) {
+		printf("%s: no band buffer\n", name);
+		failures++;
+		return;
+	}
+	direct._band = NULL;
+
+	// A full screen fill renders every band, so draw in a second frame
+	lcdFillScreen(&band, BLACK);
+	lcdFillScreen(&direct, BLACK);
+	lcdDrawFinish(&band);
+	lcdDrawFinish(&direct);
+	draw(&band, fx, width, height);
+	draw(&direct, fx, width, height);
+	lcdDrawFinish(&band);
+	lcdDrawFinish(&direct);
+	compare(&eband, &edirect, width, height, name);
+	emuFree(&eband);
+	emuFree(&edirect);
+}
+
+static void drawShapes(TFT_t * dev, FontxFile * fx, int width, int height)
+{
+	for (int i=0;i<16;i++) lcdDrawLine(dev, i*4, 0, width-1-i*3, height-1, i*0x1000);
+	lcdDrawRect(dev, 2, 3, width-3, height-4, WHITE);
+	lcdDrawRoundRect(dev, 5, 5, 40, 30, 6, PURPLE);
+	lcdDrawFillRect(dev, 20, 12, 30, 20, RED);
+}
+
+// Circles clipped at the top wrap through uint16_t
+static void drawCircles(TFT_t * dev, FontxFile * fx, int width, int height)
+{
+	lcdDrawCircle(dev, 32, 4, 10, CYAN);
+	lcdDrawFillCircle(dev, 12, 3, 8, GREEN);
+	lcdDrawFillCircle(dev, 50, 36, 9, YELLOW);
+}
+
+// Text in all directions, near the bottom of the screen
+static void drawText(TFT_t * dev, FontxFile * fx, int width, int height)
+{
+	uint8_t text[] = "Band 0123";
+	for (int direction=0;direction<4;direction++) {
+		lcdSetFontDirection(dev, direction);
+		if (direction == 2) lcdSetFontFill(dev, BLUE); else lcdUnsetFontFill(dev);
+		if (direction & 1) lcdSetFontUnderLine(dev, RED); else lcdUnsetFontUnderLine(dev);
+		lcdDrawString(dev, fx, width/2, 442, text, WHITE);
+		lcdDrawString(dev, fx, width-1, 10, text, WHITE);
+	}
+	// Upside down glyphs are drawn two rows below y.
+	// These have ink in their top rows, which land on the next band.
+	uint8_t tall[] = "[$|]";
+	lcdSetFontDirection(dev, 2);
+	lcdDrawString(dev, fx, width-1, 200, tall, WHITE);
+	lcdSetFontDirection(dev, 0);
+	lcdUnsetFontFill(dev);
+	lcdUnsetFontUnderLine(dev);
+}
+
+int main(void)
+{
+	FontxFile fx[2];
+	InitFontx(fx, FONT, "");
+
+	run("shapes 64x40", drawShapes, fx, 64, 40);
+	run("circles 64x40", drawCircles, fx, 64, 40);
+	run("text 320x480", drawText, fx, 320, 480);
+
+	CloseFontx(fx);
+	printf("%s: %d failures\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
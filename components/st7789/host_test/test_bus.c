@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "st7789.h"
+#include "st7796s_emu.h"
+
+// Arbitration of a shared bus with mock devices.
+// A mock device asks for the bus with busRequest.
+// When it owns the bus, busTake runs the mock below, which uses the bus and gives it back.
+// Built with the frame buffer and CONFIG_FLUSH_CHUNK_LINES, see Makefile.
+
+#define WIDTH 320
+#define HEIGHT 480
+#define MOCK_TURNS_MAX 8
+
+static int failures = 0;
+
+#define EXPECT(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+typedef struct {
+	BUS_t * bus;
+	EMU_t * emu;
+	// Turns the UI mock asks for again after giving the bus
+	int ui_again;
+	// Priority of the mock and pixels the panel had got at each turn
+	int turns;
+	int owner[MOCK_TURNS_MAX];
+	uint32_t pixels[MOCK_TURNS_MAX];
+} MOCK_t;
+
+// The mock device that owns the bus is done
+static void mockDone(void * arg)
+{
+	MOCK_t * mock = arg;
+	int owner = mock->bus->_owner;
+	if (mock->turns < MOCK_TURNS_MAX) {
+		mock->owner[mock->turns] = owner;
+		mock->pixels[mock->turns] = mock->emu ? mock->emu->stats.pixels : 0;
+	}
+	mock->turns++;
+	busGive(mock->bus);
+	if (owner == BUS_PRIORITY_UI && mock->ui_again > 0) {
+		mock->ui_again--;
+		EXPECT(busRequest(mock->bus, BUS_PRIORITY_UI) == false);
+	}
+}
+
+// The rules without a panel
+static void testRules(void)
+{
+	BUS_t bus;
+	MOCK_t mock;
+	busInit(&bus);
+	memset(&mock, 0, sizeof(mock));
+	mock.bus = &bus;
+	busSetMock(&bus, mockDone, &mock);
+
+	// A UI owner isn't interrupted by bulk transfers
+	EXPECT(busRequest(&bus, BUS_PRIORITY_UI) == true);
+	EXPECT(busRequest(&bus, BUS_PRIORITY_BULK) == false);
+	EXPECT(busShouldYield(&bus) == false);
+	EXPECT(busYield(&bus) == false);
+
+	// It takes turns with another UI user
+	EXPECT(busRequest(&bus, BUS_PRIORITY_UI) == false);
+	EXPECT(busShouldYield(&bus) == true);
+	EXPECT(busYield(&bus) == true);
+	EXPECT(bus._owner == BUS_PRIORITY_UI);
+	EXPECT(bus.grants[BUS_PRIORITY_UI] == 3);
+	EXPECT(bus.yields == 1);
+	EXPECT(mock.turns == 1);
+
+	// The bulk waiter gets the bus when the owner is done
+	EXPECT(busHandOver(&bus) == BUS_PRIORITY_BULK);
+	EXPECT(busHandOver(&bus) == BUS_FREE);
+
+	// A bulk owner lets everybody in
+	busTake(&bus, BUS_PRIORITY_BULK);
+	EXPECT(busRequest(&bus, BUS_PRIORITY_NORMAL) == false);
+	EXPECT(busShouldYield(&bus) == true);
+	EXPECT(busYield(&bus) == true);
+	EXPECT(bus._owner == BUS_PRIORITY_BULK);
+	EXPECT(mock.turns == 2 && mock.owner[1] == BUS_PRIORITY_NORMAL);
+	busGive(&bus);
+	EXPECT(bus._owner == BUS_FREE);
+
+	// busTake waits for a mock owner and the waiters ahead of it
+	EXPECT(busRequest(&bus, BUS_PRIORITY_BULK) == true);
+	EXPECT(busRequest(&bus, BUS_PRIORITY_NORMAL) == false);
+	busTake(&bus, BUS_PRIORITY_BULK);
+	EXPECT(bus._owner == BUS_PRIORITY_BULK);
+	EXPECT(bus.grants[BUS_PRIORITY_NORMAL] == 2);
+	EXPECT(mock.turns == 4 && mock.owner[2] == BUS_PRIORITY_BULK && mock.owner[3] == BUS_PRIORITY_NORMAL);
+	busGive(&bus);
+	EXPECT(bus._owner == BUS_FREE);
+
+	// A waiter of the same priority that came first gets the bus first
+	EXPECT(busRequest(&bus, BUS_PRIORITY_UI) == true);
+	EXPECT(busRequest(&bus, BUS_PRIORITY_UI) == false);
+	busTake(&bus, BUS_PRIORITY_UI);
+	EXPECT(mock.turns == 6);
+	busGive(&bus);
+	EXPECT(bus._owner == BUS_FREE);
+}
+
+// A chunked flush on a bus the mock devices want as well
+static void testFlush(void)
+{
+	TFT_t dev;
+	EMU_t emu;
+	BUS_t bus;
+	MOCK_t mock;
+	memset(&dev, 0, sizeof(dev));
+	emuInit(&dev, &emu, WIDTH, HEIGHT);
+	lcdInit(&dev, WIDTH, HEIGHT, 0, 0);
+	busInit(&bus);
+	lcdShareBus(&dev, &bus, BUS_PRIORITY_UI);
+	memset(&mock, 0, sizeof(mock));
+	mock.bus = &bus;
+	mock.emu = &emu;
+	busSetMock(&bus, mockDone, &mock);
+
+	// An SD read owns the bus, another one and a UI user wait.
+	// The UI user asks again after each turn, three times.
+	EXPECT(busRequest(&bus, BUS_PRIORITY_BULK) == true);
+	EXPECT(busRequest(&bus, BUS_PRIORITY_BULK) == false);
+	EXPECT(busRequest(&bus, BUS_PRIORITY_UI) == false);
+	mock.ui_again = 3;
+	emuResetStats(&emu);
+
+	lcdFillScreen(&dev, RED);
+	lcdDrawFinish(&dev);
+
+	// The flush waited for the SD read and the UI user ahead of it.
+	// Then it let the UI user in after each of the next three chunks,
+	// and nothing went to the panel while the mock had the bus.
+	uint32_t chunk = (uint32_t)CONFIG_FLUSH_CHUNK_LINES * WIDTH;
+	EXPECT(mock.turns == 5);
+	EXPECT(mock.owner[0] == BUS_PRIORITY_BULK && mock.pixels[0] == 0);
+	EXPECT(mock.owner[1] == BUS_PRIORITY_UI && mock.pixels[1] == 0);
+	for (int i=2;i<5;i++) {
+		EXPECT(mock.owner[i] == BUS_PRIORITY_UI);
+		EXPECT(mock.pixels[i] == chunk * (i-1));
+	}
+	EXPECT(emu.stats.pixels == WIDTH * HEIGHT);
+	EXPECT(bus.yields == 3);
+
+	// The waiting SD read got the bus after the flush
+	EXPECT(bus._owner == BUS_PRIORITY_BULK);
+	EXPECT(bus._waiting[BUS_PRIORITY_BULK] == 0);
+	EXPECT(bus._waiting[BUS_PRIORITY_UI] == 0);
+	busGive(&bus);
+
+	int bad = 0;
+	for (int y=0;y<HEIGHT;y++) {
+		for (int x=0;x<WIDTH;x++) {
+			if (emuGetPixel(&emu, x, y) != RED) bad++;
+		}
+	}
+	EXPECT(bad == 0);
+	emuFree(&emu);
+}
+
+int main(void)
+{
+	testRules();
+	testFlush();
+	printf("%s: %d failures\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
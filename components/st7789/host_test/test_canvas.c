@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "st7789.h"
+#include "st7789_canvas.h"
+#include "st7796s_emu.h"
+
+// Draw on a canvas of two emulated panels and compare each GRAM with its slice of a model of the canvas.
+// The right panel is apart from the left one and lower, so pixels in between are dropped.
+// Built once without and once with the frame buffer, see Makefile.
+
+#define PANEL_WIDTH 64
+#define PANEL_HEIGHT 40
+#define RIGHT_X 72
+#define RIGHT_Y 8
+#define WIDTH (RIGHT_X + PANEL_WIDTH)
+#define HEIGHT (RIGHT_Y + PANEL_HEIGHT)
+
+static uint16_t model[HEIGHT][WIDTH];
+static int failures = 0;
+
+static void modelFill(int x1, int y1, int x2, int y2, uint16_t color)
+{
+	for (int y=y1;y<=y2;y++) {
+		for (int x=x1;x<=x2;x++) model[y][x] = color;
+	}
+}
+
+// Compare the GRAM of a panel with the part of the model it shows
+static void checkPanel(EMU_t * emu, int px, int py, const char * name, const char * panel)
+{
+	int bad = 0;
+	for (int y=0;y<PANEL_HEIGHT;y++) {
+		for (int x=0;x<PANEL_WIDTH;x++) {
+			uint16_t expected = model[py+y][px+x];
+			if (emuGetPixel(emu, x, y) == expected) continue;
+			if (bad++ == 0) printf("%s: %s (%d,%d) is %04x, expected %04x\n", name, panel, x, y, emuGetPixel(emu, x, y), expected);
+		}
+	}
+	if (bad) {
+		printf("%s: %s %d pixels differ\n", name, panel, bad);
+		failures++;
+	}
+}
+
+static void check(TFT_t * dev, EMU_t * left, EMU_t * right, const char * name)
+{
+	lcdDrawFinish(dev);
+	checkPanel(left, 0, 0, name, "left");
+	checkPanel(right, RIGHT_X, RIGHT_Y, name, "right");
+}
+
+int main(void)
+{
+	TFT_t dev, left, right;
+	CANVAS_t canvas;
+	EMU_t eleft, eright;
+	memset(&dev, 0, sizeof(dev));
+	memset(&left, 0, sizeof(left));
+	memset(&right, 0, sizeof(right));
+	canvasInit(&dev, &canvas);
+	emuInit(&left, &eleft, PANEL_WIDTH, PANEL_HEIGHT);
+	emuInit(&right, &eright, PANEL_WIDTH, PANEL_HEIGHT);
+	canvasAddPanel(&dev, &left, 0, 0, PANEL_WIDTH, PANEL_HEIGHT, 0, 0);
+	canvasAddPanel(&dev, &right, RIGHT_X, RIGHT_Y, PANEL_WIDTH, PANEL_HEIGHT, 0, 0);
+	lcdInit(&dev, WIDTH, HEIGHT, 0, 0);
+
+	// Commands without a window go to every panel
+	if (eleft._display_on == false || eright._display_on == false) {
+		printf("lcdInit: Display ON not sent to every panel\n");
+		failures++;
+	}
+	lcdInversionOff(&dev);
+	if (eleft._inversion_on || eright._inversion_on) {
+		printf("lcdInversionOff: not sent to every panel\n");
+		failures++;
+	}
+
+	lcdFillScreen(&dev, BLUE);
+	modelFill(0, 0, WIDTH-1, HEIGHT-1, BLUE);
+	check(&dev, &eleft, &eright, "lcdFillScreen");
+
+	// Across the seam and the gap
+	lcdDrawFillRect(&dev, 50, 2, 90, 20, RED);
+	modelFill(50, 2, 90, 20, RED);
+	lcdDrawFillRect(&dev, 60, 30, WIDTH+5, HEIGHT+5, GREEN);
+	modelFill(60, 30, WIDTH-1, HEIGHT-1, GREEN);
+	check(&dev, &eleft, &eright, "lcdDrawFillRect");
+
+	// Pixels in the gap and above the right panel are on no panel, the model keeps them
+	lcdDrawPixel(&dev, 63, 0, WHITE);
+	lcdDrawPixel(&dev, 64, 0, WHITE);
+	lcdDrawPixel(&dev, 70, 20, WHITE);
+	lcdDrawPixel(&dev, 72, 8, WHITE);
+	lcdDrawPixel(&dev, 80, 3, WHITE);
+	lcdDrawPixel(&dev, WIDTH-1, HEIGHT-1, WHITE);
+	model[0][63] = WHITE;
+	model[0][64] = WHITE;
+	model[20][70] = WHITE;
+	model[8][72] = WHITE;
+	model[3][80] = WHITE;
+	model[HEIGHT-1][WIDTH-1] = WHITE;
+	check(&dev, &eleft, &eright, "lcdDrawPixel");
+
+#if !CONFIG_FRAME_BUFFER
+	emuResetStats(&eleft);
+	emuResetStats(&eright);
+	lcdDrawFillRect(&dev, PANEL_WIDTH, 0, RIGHT_X-1, HEIGHT-1, RED);
+	lcdDrawFillRect(&dev, PANEL_WIDTH, 0, WIDTH-1, RIGHT_Y-1, RED);
+	lcdDrawFinish(&dev);
+	if (eleft.stats.pixels != 0 || eright.stats.pixels != 0) {
+		printf("gap: %"PRIu32" and %"PRIu32" pixels sent\n", eleft.stats.pixels, eright.stats.pixels);
+		failures++;
+	}
+	modelFill(PANEL_WIDTH, 0, RIGHT_X-1, HEIGHT-1, RED);
+	modelFill(PANEL_WIDTH, 0, WIDTH-1, RIGHT_Y-1, RED);
+#endif
+
+	lcdDrawLine(&dev, 0, 25, WIDTH-1, 25, YELLOW);
+	modelFill(0, 25, WIDTH-1, 25, YELLOW);
+	lcdDrawLine(&dev, 10, 12, 10 + 30, 12 + 30, PURPLE);
+	for (int i=0;i<=30;i++) model[12+i][10+i] = PURPLE;
+	check(&dev, &eleft, &eright, "lcdDrawLine");
+
+	uint16_t colors[WIDTH];
+	for (int i=0;i<WIDTH;i++) colors[i] = i * 0x0421;
+	lcdDrawMultiPixels(&dev, 0, 10, WIDTH, colors);
+	for (int i=0;i<WIDTH;i++) model[10][i] = colors[i];
+	check(&dev, &eleft, &eright, "lcdDrawMultiPixels");
+
+	// A streamed window across the seam
+	lcdBeginWindow(&dev, 55, 5, 80, 14);
+	for (int y=5;y<=14;y++) {
+		uint16_t row[26];
+		for (int x=55;x<=80;x++) row[x-55] = model[y][x] = (x << 8) | y;
+		lcdPushPixels(&dev, row, 26);
+	}
+	lcdEndWindow(&dev);
+	check(&dev, &eleft, &eright, "lcdPushPixels");
+
+	emuFree(&eleft);
+	emuFree(&eright);
+	printf("%s: %d failures\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "st7789.h"
+#include "st7796s_emu.h"
+
+// Draw through the panel emulator and compare the GRAM with a model of the screen.
+// Built once without and once with the frame buffer, see Makefile.
+
+#define WIDTH 320
+#define HEIGHT 480
+
+static uint16_t model[HEIGHT][WIDTH];
+static int failures = 0;
+
+static void modelFill(int x1, int y1, int x2, int y2, uint16_t color)
+{
+	for (int y=y1;y<=y2;y++) {
+		for (int x=x1;x<=x2;x++) model[y][x] = color;
+	}
+}
+
+// Flush and compare the whole GRAM with the model
+static void check(TFT_t * dev, EMU_t * emu, const char * name)
+{
+	lcdDrawFinish(dev);
+	int bad = 0;
+	for (int y=0;y<HEIGHT;y++) {
+		for (int x=0;x<WIDTH;x++) {
+			if (emuGetPixel(emu, x, y) == model[y][x]) continue;
+			if (bad++ == 0) printf("%s: (%d,%d) is %04x, expected %04x\n", name, x, y, emuGetPixel(emu, x, y), model[y][x]);
+		}
+	}
+	if (bad) {
+		printf("%s: %d pixels differ\n", name, bad);
+		failures++;
+	}
+}
+
+int main(void)
+{
+	TFT_t dev;
+	EMU_t emu;
+	memset(&dev, 0, sizeof(dev));
+	emuInit(&dev, &emu, WIDTH, HEIGHT);
+	lcdInit(&dev, WIDTH, HEIGHT, 0, 0);
+
+	lcdFillScreen(&dev, BLUE);
+	modelFill(0, 0, WIDTH-1, HEIGHT-1, BLUE);
+	check(&dev, &emu, "lcdFillScreen");
+
+	lcdDrawFillRect(&dev, 10, 20, 109, 219, RED);
+	modelFill(10, 20, 109, 219, RED);
+	lcdDrawFillRect(&dev, 300, 470, 400, 500, GREEN);
+	modelFill(300, 470, WIDTH-1, HEIGHT-1, GREEN);
+	check(&dev, &emu, "lcdDrawFillRect");
+
+	lcdDrawPixel(&dev, 0, 0, WHITE);
+	lcdDrawPixel(&dev, WIDTH-1, 0, WHITE);
+	lcdDrawPixel(&dev, WIDTH, 0, WHITE);
+	model[0][0] = WHITE;
+	model[0][WIDTH-1] = WHITE;
+	check(&dev, &emu, "lcdDrawPixel");
+
+	lcdDrawLine(&dev, 5, 300, 200, 300, YELLOW);
+	modelFill(5, 300, 200, 300, YELLOW);
+	lcdDrawLine(&dev, 250, 400, 250, 250, CYAN);
+	modelFill(250, 250, 250, 400, CYAN);
+	lcdDrawLine(&dev, 20, 320, 60, 360, PURPLE);
+	for (int i=0;i<=40;i++) model[320+i][20+i] = PURPLE;
+	check(&dev, &emu, "lcdDrawLine");
+
+	lcdDrawRect(&dev, 120, 30, 180, 90, GRAY);
+	modelFill(120, 30, 180, 30, GRAY);
+	modelFill(120, 90, 180, 90, GRAY);
+	modelFill(120, 30, 120, 90, GRAY);
+	modelFill(180, 30, 180, 90, GRAY);
+	check(&dev, &emu, "lcdDrawRect");
+
+	uint16_t colors[100];
+	for (int i=0;i<100;i++) colors[i] = i * 0x0421;
+	lcdDrawMultiPixels(&dev, 200, 440, 100, colors);
+	for (int i=0;i<100;i++) model[440][200+i] = colors[i];
+	check(&dev, &emu, "lcdDrawMultiPixels");
+
+	// Every other tile of a row changes
+	for (int x=0;x<WIDTH;x+=8) {
+		lcdDrawPixel(&dev, x, 460, WHITE);
+		model[460][x] = WHITE;
+	}
+	check(&dev, &emu, "scattered pixels");
+
+#if CONFIG_FRAME_BUFFER_DIRTY
+	// Nothing changed, so a flush sends nothing
+	emuResetStats(&emu);
+	lcdDrawFinish(&dev);
+	if (emu.stats.pixels != 0) {
+		printf("lcdDrawFinish: %"PRIu32" pixels sent without drawing\n", emu.stats.pixels);
+		failures++;
+	}
+#endif
+
+#if FB_BPP <= 8
+	// Fill the palette up. The next screen gets all entries again.
+	for (int i=0;i<PALETTE_SIZE+10;i++) lcdDrawPixel(&dev, i % WIDTH, 460, i * 0x0841);
+	lcdFillScreen(&dev, PURPLE);
+	modelFill(0, 0, WIDTH-1, HEIGHT-1, PURPLE);
+	lcdDrawFillRect(&dev, 0, 0, 9, 9, 0x1234);
+	modelFill(0, 0, 9, 9, 0x1234);
+	check(&dev, &emu, "lcdFillScreen palette");
+	if (dev._palette_count != 2) {
+		printf("lcdFillScreen: %d palette entries taken\n", dev._palette_count);
+		failures++;
+	}
+#endif
+
+	emuFree(&emu);
+	printf("%s: %d failures\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "st7789.h"
+#include "st7796s_emu.h"
+
+// Draw the same calls into a packed frame buffer and straight to a second panel,
+// then compare the two GRAMs. The wrap around of the frame buffer is compared with a model.
+// Built with CONFIG_FRAME_BUFFER_MONO and with CONFIG_FRAME_BUFFER_INDEXED4, see Makefile.
+
+#define FONT16 "../../../font/ILGH16XB.FNT"
+#define FONT24 "../../../font/ILGH24XB.FNT"
+
+// The palette holds every color drawn, so both panels get the same colors
+#if FB_BPP == 1
+static const uint16_t colors[] = {BLACK, WHITE};
+#else
+static const uint16_t colors[] = {
+	BLACK, WHITE, RED, GREEN, BLUE, GRAY, YELLOW, CYAN,
+	PURPLE, 0x1234, 0x4321, 0x8888, 0xF0F0, 0x0F0F, 0xAAAA, 0x5555,
+};
+#endif
+#define COLOR(i) colors[(i) % (sizeof(colors)/sizeof(colors[0]))]
+
+static int failures = 0;
+
+static void compare(EMU_t * packed, EMU_t * direct, int width, int height, const char * name)
+{
+	int bad = 0;
+	for (int y=0;y<height;y++) {
+		for (int x=0;x<width;x++) {
+			if (emuGetPixel(packed, x, y) == emuGetPixel(direct, x, y)) continue;
+			if (bad++ == 0) printf("%s: (%d,%d) is %04x, expected %04x\n", name, x, y, emuGetPixel(packed, x, y), emuGetPixel(direct, x, y));
+		}
+	}
+	if (bad) {
+		printf("%s: %d pixels differ\n", name, bad);
+		failures++;
+	}
+}
+
+static void compareModel(EMU_t * packed, uint16_t * model, int width, int height, const char * name)
+{
+	int bad = 0;
+	for (int y=0;y<height;y++) {
+		for (int x=0;x<width;x++) {
+			if (emuGetPixel(packed, x, y) == model[y*width+x]) continue;
+			if (bad++ == 0) printf("%s: (%d,%d) is %04x, expected %04x\n", name, x, y, emuGetPixel(packed, x, y), model[y*width+x]);
+		}
+	}
+	if (bad) {
+		printf("%s: %d pixels differ\n", name, bad);
+		failures++;
+	}
+}
+
+// Fills and pixels at every position within a byte
+static void drawShapes(TFT_t * dev, FontxFile * fx16, FontxFile * fx24, int width, int height)
+{
+	for (int i=0;i<16;i++) {
+		lcdDrawFillRect(dev, 3+i*5, 10+i*3, 3+i*5+i, 12+i*3, COLOR(i+1));
+	}
+	lcdDrawFillRect(dev, width-7, height-5, width+10, height+10, COLOR(2));
+	lcdDrawFillRect(dev, 1, 60, width-2, 61, COLOR(3));
+	for (int i=0;i<64;i++) {
+		lcdDrawPixel(dev, i*5 % width, 70 + i % 7, COLOR(i));
+	}
+	lcdDrawPixel(dev, width-1, height-1, COLOR(1));
+	lcdDrawLine(dev, 0, 80, width-1, 90, COLOR(4));
+	lcdDrawFillCircle(dev, width/2, 100, 9, COLOR(5));
+}
+
+// Glyphs of direction 0 go through lcdBlitGlyph, the rest pixel by pixel
+static void drawText(TFT_t * dev, FontxFile * fx16, FontxFile * fx24, int width, int height)
+{
+	uint8_t text[] = "Pack 0123";
+	uint8_t glyph[] = "W";
+	lcdSetFontUnderLine(dev, COLOR(3));
+	for (int i=0;i<8;i++) {
+		lcdDrawString(dev, fx16, i*9+i, 20+i*18, text, COLOR(i+1));
+	}
+	lcdUnsetFontUnderLine(dev);
+	lcdDrawString(dev, fx24, 5, 200 % height, text, COLOR(2));
+
+	// At the right and bottom edges, just inside and partly outside
+	lcdSetFontUnderLine(dev, COLOR(4));
+	lcdDrawString(dev, fx16, width-8, 15, glyph, COLOR(1));
+	lcdDrawString(dev, fx24, width-12, height-1, glyph, COLOR(1));
+	lcdDrawString(dev, fx24, width-7, 40, glyph, COLOR(2));
+	lcdDrawString(dev, fx16, 3, height-1, text, COLOR(5));
+	lcdUnsetFontUnderLine(dev);
+	lcdSetFontFill(dev, COLOR(6));
+	lcdDrawString(dev, fx24, 13, 130 % height, text, COLOR(1));
+	lcdUnsetFontFill(dev);
+
+	lcdSetFontDirection(dev, 1);
+	lcdDrawString(dev, fx16, 40, 10, text, COLOR(7));
+	lcdSetFontDirection(dev, 0);
+}
+
+// Model of lcdWrapArround
+static void modelWrap(uint16_t * model, int width, int height, SCROLL_TYPE_t scroll, int start, int end)
+{
+	uint16_t *old = malloc(sizeof(uint16_t)*width*height);
+	memcpy(old, model, sizeof(uint16_t)*width*height);
+	if (scroll == SCROLL_RIGHT || scroll == SCROLL_LEFT) {
+		int d = (scroll == SCROLL_RIGHT) ? width-1 : 1;
+		for (int y=start;y<end;y++) {
+			for (int x=0;x<width;x++) model[y*width+x] = old[y*width+(x+d)%width];
+		}
+	} else {
+		int d = (scroll == SCROLL_DOWN) ? height-1 : 1;
+		for (int x=start;x<=end;x++) {
+			for (int y=0;y<height;y++) model[y*width+x] = old[((y+d)%height)*width+x];
+		}
+	}
+	free(old);
+}
+
+static void wrap(TFT_t * dev, EMU_t * emu, uint16_t * model, int width, int height, SCROLL_TYPE_t scroll, int start, int end, const char * name)
+{
+	lcdWrapArround(dev, scroll, start, end);
+	modelWrap(model, width, height, scroll, start, end);
+	lcdDrawFinish(dev);
+	compareModel(emu, model, width, height, name);
+}
+
+typedef void (*draw_t)(TFT_t * dev, FontxFile * fx16, FontxFile * fx24, int width, int height);
+
+static void run(const char * name, draw_t draw, FontxFile * fx16, FontxFile * fx24, int width, int height)
+{
+	TFT_t packed, direct;
+	EMU_t epacked, edirect;
+	memset(&packed, 0, sizeof(packed));
+	memset(&direct, 0, sizeof(direct));
+	emuInit(&packed, &epacked, width, height);
+	emuInit(&direct, &edirect, width, height);
+	lcdInit(&packed, width, height, 0, 0);
+	lcdInit(&direct, width, height, 0, 0);
+	if (packed._use_frame_buffer == false) {
+		printf("%s: no frame buffer\n", name);
+		failures++;
+		return;
+	}
+	direct._use_frame_buffer = false;
+
+	lcdFillScreen(&packed, COLOR(0));
+	lcdFillScreen(&direct, COLOR(0));
+	draw(&packed, fx16, fx24, width, height);
+	draw(&direct, fx16, fx24, width, height);
+	lcdDrawFinish(&packed);
+	compare(&epacked, &edirect, width, height, name);
+
+	// Narrow columns and rows move pixels, the whole width moves the row origin
+	uint16_t *model = malloc(sizeof(uint16_t)*width*height);
+	for (int y=0;y<height;y++) {
+		for (int x=0;x<width;x++) model[y*width+x] = emuGetPixel(&edirect, x, y);
+	}
+	char wname[64];
+	snprintf(wname, sizeof(wname), "%s wrap right", name);
+	wrap(&packed, &epacked, model, width, height, SCROLL_RIGHT, 10, 50, wname);
+	snprintf(wname, sizeof(wname), "%s wrap left", name);
+	wrap(&packed, &epacked, model, width, height, SCROLL_LEFT, 30, 70, wname);
+	snprintf(wname, sizeof(wname), "%s wrap up", name);
+	wrap(&packed, &epacked, model, width, height, SCROLL_UP, 5, 20, wname);
+	snprintf(wname, sizeof(wname), "%s wrap down", name);
+	wrap(&packed, &epacked, model, width, height, SCROLL_DOWN, 3, width-4, wname);
+	snprintf(wname, sizeof(wname), "%s wrap up whole width", name);
+	for (int i=0;i<3;i++) wrap(&packed, &epacked, model, width, height, SCROLL_UP, 0, width-1, wname);
+	snprintf(wname, sizeof(wname), "%s wrap down whole width", name);
+	wrap(&packed, &epacked, model, width, height, SCROLL_DOWN, 0, width-1, wname);
+
+	// Drawing after the origin moved
+	draw(&packed, fx16, fx24, width, height);
+	lcdDrawFinish(&packed);
+	lcdFillScreen(&direct, COLOR(0));
+	for (int y=0;y<height;y++) {
+		lcdDrawMultiPixels(&direct, 0, y, width, &model[y*width]);
+	}
+	draw(&direct, fx16, fx24, width, height);
+	snprintf(wname, sizeof(wname), "%s after wrap", name);
+	compare(&epacked, &edirect, width, height, wname);
+
+	free(model);
+	emuFree(&epacked);
+	emuFree(&edirect);
+}
+
+int main(void)
+{
+	FontxFile fx16[2];
+	FontxFile fx24[2];
+	InitFontx(fx16, FONT16, "");
+	InitFontx(fx24, FONT24, "");
+
+	run("shapes 320x480", drawShapes, fx16, fx24, 320, 480);
+	run("text 320x480", drawText, fx16, fx24, 320, 480);
+	// Rows that end inside a byte
+	run("shapes 318x120", drawShapes, fx16, fx24, 318, 120);
+	run("text 318x120", drawText, fx16, fx24, 318, 120);
+
+	CloseFontx(fx16);
+	CloseFontx(fx24);
+	printf("%s: %d failures\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "st7789.h"
+#include "st7796s_emu.h"
+
+// Scroll with VSCRDEF/VSCRSADD and compare what the emulated panel shows with a model of the screen.
+// Built once without and once with the frame buffer, see Makefile.
+
+#define WIDTH 320
+#define HEIGHT 480
+#define TOP 20
+#define BOTTOM 40
+// Commands and parameters of one scroll step, next to its pixels
+#define SCROLL_OVERHEAD 32
+
+static uint16_t screen[HEIGHT];
+static int failures = 0;
+
+static uint16_t rowColor(int y)
+{
+	return y + 1;
+}
+
+// Move the model of the scroll area like the panel does
+static void modelScroll(int lines, uint16_t color)
+{
+	int y1 = TOP;
+	int y2 = HEIGHT - BOTTOM - 1;
+	if (lines > 0) {
+		for (int y=y1;y<=y2;y++) screen[y] = (y + lines <= y2) ? screen[y + lines] : color;
+	} else {
+		for (int y=y2;y>=y1;y--) screen[y] = (y + lines >= y1) ? screen[y + lines] : color;
+	}
+}
+
+// Compare the rows the panel shows with the model
+static void check(EMU_t * emu, const char * name)
+{
+	int bad = 0;
+	for (int y=0;y<HEIGHT;y++) {
+		for (int x=0;x<WIDTH;x+=WIDTH-1) {
+			if (emuGetVisiblePixel(emu, x, y) == screen[y]) continue;
+			if (bad++ == 0) printf("%s: (%d,%d) shows %04x, expected %04x\n", name, x, y, emuGetVisiblePixel(emu, x, y), screen[y]);
+		}
+	}
+	if (bad) {
+		printf("%s: %d pixels differ\n", name, bad);
+		failures++;
+	}
+}
+
+// Scroll and check that only the rows that came into view were sent
+static void scroll(TFT_t * dev, EMU_t * emu, int lines, uint16_t color, const char * name)
+{
+	uint32_t count = (lines < 0) ? -lines : lines;
+	emuResetStats(emu);
+	lcdScroll(dev, lines, color);
+	modelScroll(lines, color);
+	if (emu->stats.pixels != count * WIDTH || emu->stats.bytes > count * WIDTH * 2 + SCROLL_OVERHEAD) {
+		printf("%s: %"PRIu32" pixels in %"PRIu32" bytes sent for %"PRIu32" lines\n", name, emu->stats.pixels, emu->stats.bytes, count);
+		failures++;
+	}
+	check(emu, name);
+}
+
+int main(void)
+{
+	TFT_t dev;
+	EMU_t emu;
+	memset(&dev, 0, sizeof(dev));
+	emuInit(&dev, &emu, WIDTH, HEIGHT);
+	lcdInit(&dev, WIDTH, HEIGHT, 0, 0);
+
+	for (int y=0;y<HEIGHT;y++) {
+		lcdDrawFillRect(&dev, 0, y, WIDTH-1, y, rowColor(y));
+		screen[y] = rowColor(y);
+	}
+	lcdDrawFinish(&dev);
+	check(&emu, "no scroll");
+
+	lcdSetScrollArea(&dev, TOP, BOTTOM);
+	check(&emu, "lcdSetScrollArea");
+
+	scroll(&dev, &emu, 10, BLACK, "scroll up");
+
+	// 420 rows of scroll area aren't a multiple of 25, so the new rows wrap around its end
+	for (int i=0;i<20;i++) {
+		scroll(&dev, &emu, 25, (i % 2) ? RED : GREEN, "scroll up wrapped");
+	}
+
+	for (int i=0;i<5;i++) {
+		scroll(&dev, &emu, -30, (i % 2) ? WHITE : BLUE, "scroll down");
+	}
+
+	// The rows drawn by lcdScroll are where lcdScrollRow says
+	for (int y=0;y<HEIGHT;y++) {
+		if (emuGetPixel(&emu, 0, lcdScrollRow(&dev, y)) != screen[y]) {
+			printf("lcdScrollRow: row %d maps to %d\n", y, lcdScrollRow(&dev, y));
+			failures++;
+			break;
+		}
+	}
+
+	// The panel shows the frame memory as it is again
+	lcdSetScrollArea(&dev, 0, 0);
+	for (int y=0;y<HEIGHT;y++) screen[y] = emuGetPixel(&emu, 0, y);
+	check(&emu, "scroll off");
+
+	emuFree(&emu);
+	printf("%s: %d failures\n", __FILE__, failures);
+	return failures ? 1 : 0;
+}
@@ -2,214 +2,275 @@
 #include <inttypes.h>
 #include <math.h>
 
+#ifdef ESP_PLATFORM
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
-#include <driver/spi_master.h>
-#include <driver/gpio.h>
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#else
+#include "st7789_host.h"
+#endif
 
 #include "st7789.h"
 
 #define TAG "ST7789"
+
+// Lines per chunk of a frame flush on a shared bus
+#ifdef CONFIG_FLUSH_CHUNK_LINES
+#define FLUSH_CHUNK_LINES CONFIG_FLUSH_CHUNK_LINES
+#else
+#define FLUSH_CHUNK_LINES 32
+#endif
+// CPU core of the flush task, tskNO_AFFINITY to let the scheduler pick one
+#if defined(CONFIG_FLUSH_TASK_CORE) && CONFIG_FLUSH_TASK_CORE >= 0 && !CONFIG_FREERTOS_UNICORE
+#define FLUSH_TASK_CORE CONFIG_FLUSH_TASK_CORE
+#else
+#define FLUSH_TASK_CORE tskNO_AFFINITY
+#endif
+// Where lcdInit puts the frame buffer
+#if CONFIG_FRAME_BUFFER_INTERNAL
+#define FRAME_BUFFER_PLACEMENT LCD_FB_INTERNAL
+#elif CONFIG_FRAME_BUFFER_PSRAM
+#define FRAME_BUFFER_PLACEMENT LCD_FB_PSRAM
+#else
+#define FRAME_BUFFER_PLACEMENT LCD_FB_AUTO
+#endif
 #define	_DEBUG_ 0
 
-#if 0
-#ifdef CONFIG_IDF_TARGET_ESP32
-#define LCD_HOST HSPI_HOST
-#elif defined CONFIG_IDF_TARGET_ESP32S2
-#define LCD_HOST SPI2_HOST
-#elif defined CONFIG_IDF_TARGET_ESP32S3
-#define LCD_HOST SPI2_HOST
-#elif defined CONFIG_IDF_TARGET_ESP32C3
-#define LCD_HOST SPI2_HOST
-#elif defined CONFIG_IDF_TARGET_ESP32P4
-#define LCD_HOST SPI2_HOST
+#if CONFIG_FRAME_BUFFER_NATIVE
+// The frame buffer holds pixels in the panel byte order
+#define FB_COLOR(color) __builtin_bswap16(color)
+#else
+#define FB_COLOR(color) (color)
 #endif
+
+#if FB_BPP <= 8
+// The frame buffer holds palette indices
+static uint8_t lcdColorIndex(TFT_t * dev, uint16_t color);
+#define FB_PIXEL(dev, color) lcdColorIndex(dev, color)
+#define FB_RGB(dev, pixel) ((dev)->_palette[pixel])
+#else
+#define FB_PIXEL(dev, color) FB_COLOR(color)
+#define FB_RGB(dev, pixel) FB_COLOR(pixel)
 #endif
 
-#if CONFIG_SPI2_HOST
-#define HOST_ID SPI2_HOST
-#elif CONFIG_SPI3_HOST
-#define HOST_ID SPI3_HOST
+// Row of the frame buffer that holds row y of the screen.
+// Rows start at _fb_origin and wrap around at the end of the frame buffer, see lcdWrapArround.
+#define FB_ROW(dev, y) lcdFbRow(dev, y)
+
+static inline uint32_t lcdFbRow(TFT_t * dev, uint32_t y)
+{
+	uint32_t row = y + dev->_fb_origin;
+	return (row >= dev->_height) ? row - dev->_height : row;
+}
+
+// Elements of a frame buffer row, and the element of pixel x,y
+#if FB_BPP < 8
+#define FB_PER_BYTE (8 / FB_BPP)
+#define FB_STRIDE(dev) (((dev)->_width + FB_PER_BYTE - 1) / FB_PER_BYTE)
+#define FB_INDEX(dev, x, y) (FB_ROW(dev, y) * FB_STRIDE(dev) + (x) / FB_PER_BYTE)
+#define FB_GET(dev, x, y) lcdFbGet(dev, x, y)
+#define FB_SET(dev, x, y, pixel) lcdFbSet(dev, x, y, pixel)
+
+static inline uint8_t lcdFbGet(TFT_t * dev, uint16_t x, uint16_t y)
+{
+	uint8_t byte = dev->_frame_buffer[FB_INDEX(dev, x, y)];
+	int shift = 8 - FB_BPP * (x % FB_PER_BYTE + 1);
+	return (byte >> shift) & ((1 << FB_BPP) - 1);
+}
+
+static inline void lcdFbSet(TFT_t * dev, uint16_t x, uint16_t y, uint8_t pixel)
+{
+	uint8_t *byte = &dev->_frame_buffer[FB_INDEX(dev, x, y)];
+	int shift = 8 - FB_BPP * (x % FB_PER_BYTE + 1);
+	uint8_t mask = ((1 << FB_BPP) - 1) << shift;
+	*byte = (*byte & ~mask) | ((pixel << shift) & mask);
+}
+#else
+#define FB_STRIDE(dev) ((dev)->_width)
+#define FB_INDEX(dev, x, y) (FB_ROW(dev, y) * (dev)->_width + (x))
+#define FB_GET(dev, x, y) ((dev)->_frame_buffer[FB_INDEX(dev, x, y)])
+#define FB_SET(dev, x, y, pixel) ((dev)->_frame_buffer[FB_INDEX(dev, x, y)] = (pixel))
 #endif
 
-#define SPI_DEFAULT_FREQUENCY SPI_MASTER_FREQ_20M; // 20MHz
-
-static const int SPI_Command_Mode = 0;
-static const int SPI_Data_Mode = 1;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_20M;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_26M;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_40M;
-//static const int SPI_Frequency = 60000000;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_80M;
-
-int clock_speed_hz = SPI_DEFAULT_FREQUENCY;
-
-void spi_clock_speed(int speed) {
-	ESP_LOGI(TAG, "SPI clock speed=%d MHz", speed/1000000);
-	clock_speed_hz = speed;
-}
-
-void spi_master_init(TFT_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
-{
-	esp_err_t ret;
-
-	ESP_LOGI(TAG, "GPIO_CS=%d",GPIO_CS);
-	if ( GPIO_CS >= 0 ) {
-		//gpio_pad_select_gpio( GPIO_CS );
-		gpio_reset_pin( GPIO_CS );
-		gpio_set_direction( GPIO_CS, GPIO_MODE_OUTPUT );
-		gpio_set_level( GPIO_CS, 0 );
-	}
-
-	ESP_LOGI(TAG, "GPIO_DC=%d",GPIO_DC);
-	//gpio_pad_select_gpio( GPIO_DC );
-	gpio_reset_pin( GPIO_DC );
-	gpio_set_direction( GPIO_DC, GPIO_MODE_OUTPUT );
-	gpio_set_level( GPIO_DC, 0 );
-
-	ESP_LOGI(TAG, "GPIO_RESET=%d",GPIO_RESET);
-	if ( GPIO_RESET >= 0 ) {
-		//gpio_pad_select_gpio( GPIO_RESET );
-		gpio_reset_pin( GPIO_RESET );
-		gpio_set_direction( GPIO_RESET, GPIO_MODE_OUTPUT );
-		gpio_set_level( GPIO_RESET, 1 );
-		delayMS(100);
-		gpio_set_level( GPIO_RESET, 0 );
-		delayMS(100);
-		gpio_set_level( GPIO_RESET, 1 );
-		delayMS(100);
-	}
-
-	ESP_LOGI(TAG, "GPIO_BL=%d",GPIO_BL);
-	if ( GPIO_BL >= 0 ) {
-		//gpio_pad_select_gpio(GPIO_BL);
-		gpio_reset_pin(GPIO_BL);
-		gpio_set_direction( GPIO_BL, GPIO_MODE_OUTPUT );
-		gpio_set_level( GPIO_BL, 0 );
-	}
-
-	ESP_LOGI(TAG, "GPIO_MOSI=%d",GPIO_MOSI);
-	ESP_LOGI(TAG, "GPIO_SCLK=%d",GPIO_SCLK);
-	spi_bus_config_t buscfg = {
-		.mosi_io_num = GPIO_MOSI,
-		.miso_io_num = -1,
-		.sclk_io_num = GPIO_SCLK,
-		.quadwp_io_num = -1,
-		.quadhd_io_num = -1,
-		.max_transfer_sz = 0,
-		.flags = 0
-	};
-
-	ret = spi_bus_initialize( HOST_ID, &buscfg, SPI_DMA_CH_AUTO );
-	ESP_LOGD(TAG, "spi_bus_initialize=%d",ret);
-	assert(ret==ESP_OK);
-
-	spi_device_interface_config_t devcfg;
-	memset(&devcfg, 0, sizeof(devcfg));
-	//devcfg.clock_speed_hz = SPI_Frequency;
-	devcfg.clock_speed_hz = clock_speed_hz;
-	devcfg.queue_size = 7;
-	//devcfg.mode = 2;
-	devcfg.mode = 3;
-	devcfg.flags = SPI_DEVICE_NO_DUMMY;
-
-	if ( GPIO_CS >= 0 ) {
-		devcfg.spics_io_num = GPIO_CS;
-	} else {
-		devcfg.spics_io_num = -1;
-	}
-	
-	spi_device_handle_t handle;
-	ret = spi_bus_add_device( HOST_ID, &devcfg, &handle);
-	ESP_LOGD(TAG, "spi_bus_add_device=%d",ret);
-	assert(ret==ESP_OK);
-	dev->_dc = GPIO_DC;
-	dev->_bl = GPIO_BL;
-	dev->_SPIHandle = handle;
-}
-
-bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength)
-{
-	spi_transaction_t SPITransaction;
-	esp_err_t ret;
-
-	if ( DataLength > 0 ) {
-		memset( &SPITransaction, 0, sizeof( spi_transaction_t ) );
-		SPITransaction.length = DataLength * 8;
-		SPITransaction.tx_buffer = Data;
-#if 1
-		ret = spi_device_transmit( SPIHandle, &SPITransaction );
+#if CONFIG_FRAME_BUFFER_DIRTY
+// Side of the square tiles of LCD_DIRTY_TILES in pixels
+#ifdef CONFIG_DIRTY_TILE_SIZE
+#define DIRTY_TILE_SIZE CONFIG_DIRTY_TILE_SIZE
 #else
-		ret = spi_device_polling_transmit( SPIHandle, &SPITransaction );
+#define DIRTY_TILE_SIZE 16
 #endif
-		assert(ret==ESP_OK); 
-	}
+// Clean tiles between two dirty tiles of a row that are sent rather than opening another window
+#ifdef CONFIG_DIRTY_TILE_GAP
+#define DIRTY_TILE_GAP CONFIG_DIRTY_TILE_GAP
+#else
+#define DIRTY_TILE_GAP 1
+#endif
+// Runs of dirty tiles in a row. Each run but the last is followed by more than DIRTY_TILE_GAP clean tiles.
+#define DIRTY_RUNS_MAX(tiles_x) (((tiles_x) + DIRTY_TILE_GAP + 1) / (DIRTY_TILE_GAP + 2))
 
-	return true;
+// Record an area of the frame buffer that differs from the panel
+static void lcdAddDirty(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+#define FB_DIRTY(dev, x1, y1, x2, y2) lcdAddDirty(dev, x1, y1, x2, y2)
+#else
+#define FB_DIRTY(dev, x1, y1, x2, y2) do { } while (0)
+#endif
+
+// Drawing calls are recorded for band rendering, see st7789_band.h
+#define BAND_RECORDING(dev) ((dev)->_band && (dev)->_band->replaying == false && (dev)->_band->direct == false)
+// Drawing goes to the band buffer
+#define BAND_REPLAYING(dev) ((dev)->_band && (dev)->_band->replaying)
+static void lcdBandFlush(TFT_t * dev);
+static void lcdSendFrame(TFT_t *dev, lcd_pixel_t *buffer, const lcd_dirty_t *dirty);
+
+#if CONFIG_LCD_LOCK
+// _lock guards the frame buffer and the command sequences.
+// _flush_lock guards the SPI output of lcdDrawFinishSnapshot while _lock is released.
+// Always take _lock first.
+#define LCD_LOCK(dev) xSemaphoreTakeRecursive((dev)->_lock, portMAX_DELAY)
+#define LCD_UNLOCK(dev) xSemaphoreGiveRecursive((dev)->_lock)
+#define FLUSH_LOCK(dev) xSemaphoreTake((dev)->_flush_lock, portMAX_DELAY)
+#define FLUSH_UNLOCK(dev) xSemaphoreGive((dev)->_flush_lock)
+#else
+#define LCD_LOCK(dev) do { } while (0)
+#define LCD_UNLOCK(dev) do { } while (0)
+#define FLUSH_LOCK(dev) do { } while (0)
+#define FLUSH_UNLOCK(dev) do { } while (0)
+#endif
+
+// Wait until the transport has sent everything
+static void lcdSync(TFT_t * dev)
+{
+	dev->_ops->flush(dev);
+}
+
+// Wait until the transport has sent everything.
+// The flush task of lcdDrawFinishAsync uses the same transport, so its flush is waited for first.
+void spi_master_sync(TFT_t * dev)
+{
+	lcdWaitFlush(dev);
+	lcdSync(dev);
+}
+
+// Send any number of data bytes.
+// Up to 4 bytes are copied, longer data must stay untouched until spi_master_sync() returns.
+bool spi_master_write_data(TFT_t * dev, const uint8_t * Data, uint32_t DataLength)
+{
+	dev->_win_pos += DataLength / 2;
+	LCD_STATS_ADD(dev, pixel_bytes, DataLength);
+	return dev->_ops->write_data(dev, Data, DataLength);
 }
 
 bool spi_master_write_command(TFT_t * dev, uint8_t cmd)
 {
-	static uint8_t Byte = 0;
-	Byte = cmd;
-	gpio_set_level( dev->_dc, SPI_Command_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, &Byte, 1 );
+	// Any command may move the GRAM write position
+	dev->_win_valid = false;
+	LCD_STATS_ADD(dev, commands, 1);
+	return dev->_ops->write_command(dev, cmd);
 }
 
 bool spi_master_write_data_byte(TFT_t * dev, uint8_t data)
 {
-	static uint8_t Byte = 0;
-	Byte = data;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, &Byte, 1 );
+	return dev->_ops->write_data(dev, &data, 1);
 }
 
 
 bool spi_master_write_data_word(TFT_t * dev, uint16_t data)
 {
-	static uint8_t Byte[2];
+	uint8_t Byte[2];
 	Byte[0] = (data >> 8) & 0xFF;
 	Byte[1] = data & 0xFF;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, 2);
+	dev->_win_pos++;
+	return dev->_ops->write_data(dev, Byte, 2);
 }
 
 bool spi_master_write_addr(TFT_t * dev, uint16_t addr1, uint16_t addr2)
 {
-	static uint8_t Byte[4];
+	uint8_t Byte[4];
 	Byte[0] = (addr1 >> 8) & 0xFF;
 	Byte[1] = addr1 & 0xFF;
 	Byte[2] = (addr2 >> 8) & 0xFF;
 	Byte[3] = addr2 & 0xFF;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, 4);
+	return dev->_ops->write_data(dev, Byte, 4);
 }
 
-bool spi_master_write_color(TFT_t * dev, uint16_t color, uint16_t size)
+// Fill size pixels with one color
+bool spi_master_write_color(TFT_t * dev, uint16_t color, uint32_t size)
 {
-	static uint8_t Byte[1024];
-	int index = 0;
-	for(int i=0;i<size;i++) {
-		Byte[index++] = (color >> 8) & 0xFF;
-		Byte[index++] = color & 0xFF;
-	}
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, size*2);
+	dev->_win_pos += size;
+	LCD_STATS_ADD(dev, pixel_bytes, size*2);
+	return dev->_ops->write_color(dev, color, size);
 }
 
 // Add 202001
 bool spi_master_write_colors(TFT_t * dev, uint16_t * colors, uint16_t size)
 {
-	static uint8_t Byte[1024];
-	int index = 0;
-	for(int i=0;i<size;i++) {
-		Byte[index++] = (colors[i] >> 8) & 0xFF;
-		Byte[index++] = colors[i] & 0xFF;
+	return spi_master_write_pixels(dev, colors, size);
+}
+
+// Send any number of pixels in the host byte order
+bool spi_master_write_pixels(TFT_t * dev, const uint16_t * colors, uint32_t size)
+{
+	dev->_win_pos += size;
+	LCD_STATS_ADD(dev, pixel_bytes, size*2);
+	return dev->_ops->write_pixels(dev, colors, size);
+}
+
+// Send any number of palette indices.
+// Each index is sent as palette[index] in the panel byte order.
+bool spi_master_write_indexed(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size)
+{
+	dev->_win_pos += size;
+	LCD_STATS_ADD(dev, pixel_bytes, size*2);
+	return dev->_ops->write_indexed(dev, index, palette, size);
+}
+
+// Send any number of packed pixels.
+// data:1 or 4 bit pixels, starting at a byte
+// lut:table of lcdUnpackPixels
+bool spi_master_write_packed(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size)
+{
+	dev->_win_pos += size;
+	LCD_STATS_ADD(dev, pixel_bytes, size*2);
+	return dev->_ops->write_packed(dev, data, bpp, lut, size);
+}
+
+// Entry of lut for the byte or nibble that holds pixel i
+static inline const uint8_t * lcdLutEntry(const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t i)
+{
+	uint8_t byte = data[i * bpp / 8];
+	if (bpp == 4) return &lut[byte * 4];
+	return &lut[((i & 4) ? (byte & 0x0F) : (byte >> 4)) * 8];
+}
+
+// Expand packed pixels to RGB565 in the panel byte order.
+// With 4 bits, lut holds the 2 pixels of each byte value. With 1 bit, it holds the 4 pixels of each nibble value,
+// which keeps the table at 128 bytes. Whole bytes or nibbles are copied with one lookup.
+// data:packed pixels, the leftmost in the most significant bits
+// first:first pixel to expand
+// count:number of pixels
+// out:2 bytes per pixel
+void lcdUnpackPixels(const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t first, uint32_t count, uint8_t * out)
+{
+	uint32_t step = (bpp == 4) ? 2 : 4;
+	uint32_t end = first + count;
+	uint32_t i = first;
+	while (i < end && (i % step || end - i < step)) {
+		memcpy(out, &lcdLutEntry(data, bpp, lut, i)[(i % step)*2], 2);
+		out += 2;
+		i++;
+	}
+	while (end - i >= step) {
+		memcpy(out, lcdLutEntry(data, bpp, lut, i), step*2);
+		out += step*2;
+		i += step;
+	}
+	while (i < end) {
+		memcpy(out, &lcdLutEntry(data, bpp, lut, i)[(i % step)*2], 2);
+		out += 2;
+		i++;
 	}
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, size*2);
 }
 
 void delayMS(int ms) {
@@ -220,7 +281,23 @@ void delayMS(int ms) {
 }
 
 
-void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
+// Forget the semaphores and the flush task of dev.
+// The transport calls it once when dev is attached, so lcdInitState creates them only the first time.
+void lcdClearHandles(TFT_t * dev)
+{
+#if CONFIG_LCD_LOCK
+	dev->_lock = NULL;
+	dev->_flush_lock = NULL;
+#endif
+#ifdef ESP_PLATFORM
+	dev->_flush_task = NULL;
+	dev->_flush_idle = NULL;
+#endif
+}
+
+// Set up the driver state of dev without sending anything to the panel.
+// It may be called again for the same dev, the semaphores and the flush task are kept.
+void lcdInitState(TFT_t * dev, int width, int height, int offsetx, int offsety)
 {
 	dev->_width = width;
 	dev->_height = height;
@@ -229,6 +306,72 @@ void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
 	dev->_font_direction = DIRECTION0;
 	dev->_font_fill = false;
 	dev->_font_underline = false;
+	// The whole screen scrolls, from its first row
+	dev->_scroll_top = 0;
+	dev->_scroll_height = height;
+	dev->_scroll_start = 0;
+	dev->_win_valid = false;
+	dev->_win_pos = 0;
+	dev->_stream_active = false;
+	lcdResetStats(dev);
+#if CONFIG_LCD_LOCK
+	if (dev->_lock == NULL) dev->_lock = xSemaphoreCreateRecursiveMutex();
+	if (dev->_flush_lock == NULL) dev->_flush_lock = xSemaphoreCreateMutex();
+	assert(dev->_lock != NULL && dev->_flush_lock != NULL);
+#endif
+	dev->_fb_placement = LCD_FB_INTERNAL;
+	dev->_fb_origin = 0;
+#if FB_BPP <= 8
+	memset(dev->_palette, 0, sizeof(dev->_palette));
+	memset(dev->_palette_cache, 0, sizeof(dev->_palette_cache));
+	dev->_palette_count = 0;
+#endif
+#if FB_BPP < 8
+	// Every entry is black like the palette
+	memset(dev->_lut, 0, sizeof(dev->_lut));
+#endif
+	dev->_snapshot = NULL;
+	dev->_shared = NULL;
+	dev->_priority = BUS_PRIORITY_UI;
+	dev->_band = NULL;
+#ifdef ESP_PLATFORM
+	dev->_double = false;
+	if (dev->_flush_idle == NULL) {
+		dev->_flush_idle = xSemaphoreCreateBinary();
+		assert(dev->_flush_idle != NULL);
+		xSemaphoreGive(dev->_flush_idle);
+	}
+#endif
+}
+
+// Allocate a buffer of one frame.
+// placement:LCD_FB_INTERNAL takes DMA-capable internal RAM, LCD_FB_PSRAM takes PSRAM,
+//           LCD_FB_AUTO tries internal RAM first and PSRAM next.
+// *placed is set to where the buffer is. It isn't changed when there is no memory and NULL is returned.
+// PSRAM can't be read by the SPI DMA, the transport copies it through its bounce buffers.
+static lcd_pixel_t * lcdAllocFrame(TFT_t * dev, int placement, uint8_t * placed)
+{
+	uint32_t size = sizeof(lcd_pixel_t)*FB_STRIDE(dev)*dev->_height;
+	if (placement != LCD_FB_PSRAM) {
+		lcd_pixel_t *buffer = heap_caps_malloc(size, MALLOC_CAP_DMA);
+		if (buffer) {
+			*placed = LCD_FB_INTERNAL;
+			return buffer;
+		}
+	}
+	if (placement != LCD_FB_INTERNAL) {
+		lcd_pixel_t *buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+		if (buffer) {
+			*placed = LCD_FB_PSRAM;
+			return buffer;
+		}
+	}
+	return NULL;
+}
+
+void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
+{
+	lcdInitState(dev, width, height, offsetx, offsety);
 
 	spi_master_write_command(dev, 0x01);	//Software Reset
 	delayMS(150);
@@ -264,23 +407,487 @@ void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
 	spi_master_write_command(dev, 0x29);	//Display ON
 	delayMS(255);
 
-	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 1 );
-	}
+	lcdSync(dev);
+	dev->_ops->backlight(dev, 1);
 
 	dev->_use_frame_buffer = false;
 #if CONFIG_FRAME_BUFFER
-	dev->_frame_buffer = heap_caps_malloc(sizeof(uint16_t)*width*height, MALLOC_CAP_DMA);
+	dev->_frame_buffer = lcdAllocFrame(dev, FRAME_BUFFER_PLACEMENT, &dev->_fb_placement);
 	if (dev->_frame_buffer == NULL) {
 		ESP_LOGE(TAG, "heap_caps_malloc fail");
 	} else {
-		ESP_LOGI(TAG, "heap_caps_malloc success");
+		ESP_LOGI(TAG, "heap_caps_malloc success (%s)", dev->_fb_placement == LCD_FB_PSRAM ? "PSRAM" : "internal");
 		dev->_use_frame_buffer = true;
 	}
+#if CONFIG_FRAME_BUFFER_DOUBLE && defined(ESP_PLATFORM)
+	if (dev->_use_frame_buffer) {
+		// Drawn into and sent directly like the frame buffer
+		uint8_t placed;
+		dev->_snapshot = lcdAllocFrame(dev, dev->_fb_placement, &placed);
+		if (dev->_snapshot == NULL) {
+			ESP_LOGW(TAG, "No memory for the second frame buffer");
+		} else {
+			dev->_double = true;
+		}
+	}
+#endif
+#if CONFIG_FRAME_BUFFER_DIRTY
+	dev->_tiles_x = (width + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+	dev->_tiles_y = (height + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+	uint32_t tiles_size = ((uint32_t)dev->_tiles_x * dev->_tiles_y + 7) / 8;
+	dev->_dirty_tiles = heap_caps_malloc(tiles_size, MALLOC_CAP_8BIT);
+	dev->_flush_tiles = heap_caps_malloc(tiles_size, MALLOC_CAP_8BIT);
+	// Open and new runs of lcdForEachTileArea, kept off the stack of the flush task
+	dev->_tile_runs = heap_caps_malloc(sizeof(lcd_rect_t) * DIRTY_RUNS_MAX(dev->_tiles_x) * 2, MALLOC_CAP_8BIT);
+	if (dev->_dirty_tiles && dev->_flush_tiles && dev->_tile_runs) {
+		memset(dev->_dirty_tiles, 0, tiles_size);
+		memset(dev->_flush_tiles, 0, tiles_size);
+	} else {
+		ESP_LOGW(TAG, "No memory for the dirty tiles");
+		heap_caps_free(dev->_dirty_tiles);
+		heap_caps_free(dev->_flush_tiles);
+		heap_caps_free(dev->_tile_runs);
+		dev->_dirty_tiles = NULL;
+		dev->_flush_tiles = NULL;
+		dev->_tile_runs = NULL;
+	}
+#if CONFIG_DIRTY_TILES
+	dev->_dirty_mode = dev->_dirty_tiles ? LCD_DIRTY_TILES : LCD_DIRTY_RECTS;
+#else
+	dev->_dirty_mode = LCD_DIRTY_RECTS;
+#endif
+	dev->_dirty_count = 0;
+	FB_DIRTY(dev, 0, 0, width-1, height-1);
+#endif
+
+#endif
+
+#if CONFIG_BAND_RENDERING
+	if (dev->_use_frame_buffer == false) {
+		BAND_t *band = heap_caps_malloc(sizeof(BAND_t), MALLOC_CAP_8BIT);
+		uint16_t lines = (CONFIG_BAND_LINES < height) ? CONFIG_BAND_LINES : height;
+		if (lines * BAND_MAX < height) lines = (height + BAND_MAX - 1) / BAND_MAX;
+		uint16_t *buffer = heap_caps_malloc(sizeof(uint16_t)*width*lines, MALLOC_CAP_DMA);
+		uint8_t *list = heap_caps_malloc(CONFIG_BAND_LIST_SIZE, MALLOC_CAP_8BIT);
+		if (band && buffer && list) {
+			ESP_LOGI(TAG, "band rendering %d lines", lines);
+			bandInit(band, buffer, lines, list, CONFIG_BAND_LIST_SIZE);
+			bandMarkRows(band, 0, height-1);
+			dev->_band = band;
+		} else {
+			ESP_LOGE(TAG, "No memory for band rendering");
+			heap_caps_free(band);
+			heap_caps_free(buffer);
+			heap_caps_free(list);
+		}
+	}
+#endif
+}
+
+// Move the frame buffer to placement, keeping what is drawn.
+// The second frame buffer and the copy of lcdDrawFinishSnapshot move with it.
+// placement:LCD_FB_INTERNAL, LCD_FB_PSRAM or LCD_FB_AUTO
+// Returns false and leaves everything in place when there is no memory for it.
+bool lcdPlaceFrameBuffer(TFT_t *dev, int placement)
+{
+	if (dev->_use_frame_buffer == false) return false;
+	uint32_t size = sizeof(lcd_pixel_t)*FB_STRIDE(dev)*dev->_height;
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
+	uint8_t placed, snapshot_placed;
+	lcd_pixel_t *buffer = lcdAllocFrame(dev, placement, &placed);
+	lcd_pixel_t *snapshot = NULL;
+	if (buffer && dev->_snapshot) {
+		snapshot = lcdAllocFrame(dev, placed, &snapshot_placed);
+		if (snapshot == NULL) {
+			heap_caps_free(buffer);
+			buffer = NULL;
+		}
+	}
+	if (buffer == NULL) {
+		ESP_LOGW(TAG, "No memory to move the frame buffer");
+		FLUSH_UNLOCK(dev);
+		LCD_UNLOCK(dev);
+		return false;
+	}
+
+	memcpy(buffer, dev->_frame_buffer, size);
+	heap_caps_free(dev->_frame_buffer);
+	dev->_frame_buffer = buffer;
+	if (snapshot) {
+		// The second frame buffer holds the frame before
+		memcpy(snapshot, dev->_snapshot, size);
+		heap_caps_free(dev->_snapshot);
+		dev->_snapshot = snapshot;
+	}
+	dev->_fb_placement = placed;
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
+	return true;
+}
+
+#if FB_BPP <= 8
+// Recently used colors by a hash of the color
+#define PALETTE_HASH(color) (((color) ^ ((color) >> 6) ^ ((color) >> 11)) % PALETTE_CACHE_SIZE)
+
+// Palette entry closest to color
+static uint8_t lcdNearestIndex(TFT_t * dev, uint16_t color)
+{
+	int best = 0;
+	int32_t best_distance = INT32_MAX;
+	for (int i=0;i<dev->_palette_count;i++) {
+		uint16_t c = dev->_palette[i];
+		int32_t r = (int32_t)(c >> 11) - (color >> 11);
+		int32_t g = (int32_t)((c >> 5) & 0x3F) - ((color >> 5) & 0x3F);
+		int32_t b = (int32_t)(c & 0x1F) - (color & 0x1F);
+		// Green has one more bit
+		int32_t distance = 4*r*r + g*g + 4*b*b;
+		if (distance < best_distance) {
+			best = i;
+			best_distance = distance;
+		}
+	}
+	return best;
+}
+
+#if FB_BPP < 8
+// Fill the table of lcdUnpackPixels from the palette
+static void lcdBuildLut(TFT_t * dev)
+{
+	int step = (FB_BPP == 4) ? 2 : 4;
+	for (int key=0;key<(1 << (step*FB_BPP));key++) {
+		uint8_t *entry = &dev->_lut[key*step*2];
+		for (int i=0;i<step;i++) {
+			uint16_t color = dev->_palette[(key >> (FB_BPP*(step-1-i))) & ((1 << FB_BPP) - 1)];
+			entry[i*2] = (color >> 8) & 0xFF;
+			entry[i*2+1] = color & 0xFF;
+		}
+	}
+}
+#endif
+
+// Palette index of color.
+// A color gets the next free entry when it is first drawn.
+// Once all entries are taken, the closest entry is used.
+static uint8_t lcdColorIndex(TFT_t * dev, uint16_t color)
+{
+	uint8_t *cache = &dev->_palette_cache[PALETTE_HASH(color)];
+	if (*cache < dev->_palette_count && dev->_palette[*cache] == color) return *cache;
+	for (int i=0;i<dev->_palette_count;i++) {
+		if (dev->_palette[i] == color) {
+			*cache = i;
+			return i;
+		}
+	}
+	if (dev->_palette_count < PALETTE_SIZE) {
+		dev->_palette[dev->_palette_count] = color;
+		*cache = dev->_palette_count++;
+#if FB_BPP < 8
+		lcdBuildLut(dev);
+#endif
+		return *cache;
+	}
+	*cache = lcdNearestIndex(dev, color);
+	return *cache;
+}
+#endif
+
+// Palette index that drawing in color stores.
+// Use it to find the entry to change with lcdSetPalette.
+// Without a palette format of the frame buffer it is always 0.
+uint8_t lcdPaletteIndex(TFT_t *dev, uint16_t color)
+{
+#if FB_BPP <= 8
+	LCD_LOCK(dev);
+	uint8_t index = lcdColorIndex(dev, color);
+	LCD_UNLOCK(dev);
+	return index;
+#else
+	return 0;
+#endif
+}
+
+// Change palette entries.
+// Every pixel of these entries changes color with the next flush, without drawing.
+// first:first entry to change
+// count:number of entries
+// colors:new colors
+void lcdSetPalette(TFT_t *dev, uint8_t first, uint16_t count, const uint16_t *colors)
+{
+#if FB_BPP <= 8
+#if PALETTE_SIZE < 256
+	// A uint8_t is always inside a palette of 256 entries
+	if (first >= PALETTE_SIZE) return;
+#endif
+	if (first + count > PALETTE_SIZE) count = PALETTE_SIZE - first;
+	LCD_LOCK(dev);
+	// The flush in flight keeps the old colors
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
+	memcpy(&dev->_palette[first], colors, sizeof(uint16_t)*count);
+	if (first + count > dev->_palette_count) dev->_palette_count = first + count;
+#if FB_BPP < 8
+	lcdBuildLut(dev);
+#endif
+	if (dev->_use_frame_buffer) FB_DIRTY(dev, 0, 0, dev->_width-1, dev->_height-1);
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
+#endif
+}
 
+// Give all palette entries out again, starting with the next color drawn.
+// Pixels drawn before keep their entries, so draw the whole screen again after it.
+// lcdFillScreen does this itself.
+void lcdResetPalette(TFT_t *dev)
+{
+#if FB_BPP <= 8
+	LCD_LOCK(dev);
+	// The flush in flight keeps the old colors
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
+	memset(dev->_palette_cache, 0, sizeof(dev->_palette_cache));
+	dev->_palette_count = 0;
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
 #endif
 }
 
+// Set the GRAM window and start a memory write
+// x1:Start X address (including offset)
+// y1:Start Y address (including offset)
+// x2:End X address (including offset)
+// y2:End Y address (including offset)
+// The last window is cached. An unchanged column or row range is not sent again,
+// and a window that starts on the row after the last write uses Memory Write Continue.
+static void lcdSetWindow(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	// Keep rows open to the bottom of the panel, so the following rows can continue
+	uint16_t _y2 = dev->_offsety + dev->_height - 1;
+	if (y2 > _y2) _y2 = y2;
+	bool valid = dev->_win_valid;
+	uint16_t win_y1 = dev->_win_y1;
+	uint16_t win_y2 = dev->_win_y2;
+	uint32_t win_pos = dev->_win_pos;
+
+	if (valid && dev->_win_x1 == x1 && dev->_win_x2 == x2) {
+		uint16_t w = x2 - x1 + 1;
+		if ((win_pos % w) == 0 && y1 == win_y1 + win_pos / w && y2 <= win_y2) {
+			spi_master_write_command(dev, 0x3C);	// Memory Write Continue
+			dev->_win_valid = true;
+			return;
+		}
+	} else {
+		spi_master_write_command(dev, 0x2A);	// set column(x) address
+		spi_master_write_addr(dev, x1, x2);
+		valid = false;
+	}
+	if (valid == false || y1 != win_y1 || y2 > win_y2) {
+		spi_master_write_command(dev, 0x2B);	// set Page(y) address
+		spi_master_write_addr(dev, y1, _y2);
+		win_y1 = y1;
+		win_y2 = _y2;
+		valid = false;
+	}
+	// Counted only when CASET or RASET is sent
+	if (valid == false) LCD_STATS_ADD(dev, window_sets, 1);
+	spi_master_write_command(dev, 0x2C);	// Memory Write
+	dev->_win_valid = true;
+	dev->_win_x1 = x1;
+	dev->_win_x2 = x2;
+	dev->_win_y1 = win_y1;
+	dev->_win_y2 = win_y2;
+	dev->_win_pos = 0;
+}
+
+#if CONFIG_FRAME_BUFFER_DIRTY
+static uint32_t lcdRectArea(const lcd_rect_t * r)
+{
+	return (uint32_t)(r->x2 - r->x1 + 1) * (r->y2 - r->y1 + 1);
+}
+
+static void lcdRectUnion(lcd_rect_t * r, const lcd_rect_t * d)
+{
+	if (d->x1 < r->x1) r->x1 = d->x1;
+	if (d->y1 < r->y1) r->y1 = d->y1;
+	if (d->x2 > r->x2) r->x2 = d->x2;
+	if (d->y2 > r->y2) r->y2 = d->y2;
+}
+
+// Areas that overlap or touch an entry are merged into it.
+// When the list is full, the area is merged into the entry that grows the least.
+static void lcdAddDirtyRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	// Most calls are single pixels of a shape that is being drawn
+	for (int i=0;i<dev->_dirty_count;i++) {
+		lcd_rect_t *d = &dev->_dirty[i];
+		if (x1 >= d->x1 && x2 <= d->x2 && y1 >= d->y1 && y2 <= d->y2) return;
+	}
+
+	lcd_rect_t r = {x1, y1, x2, y2};
+	while (1) {
+		bool merged = false;
+		for (int i=0;i<dev->_dirty_count;i++) {
+			lcd_rect_t *d = &dev->_dirty[i];
+			if (r.x1 > d->x2+1 || d->x1 > r.x2+1 || r.y1 > d->y2+1 || d->y1 > r.y2+1) continue;
+			// Take the entry out, the union may reach other entries
+			lcdRectUnion(&r, d);
+			dev->_dirty[i] = dev->_dirty[--dev->_dirty_count];
+			merged = true;
+			break;
+		}
+		if (merged) continue;
+		if (dev->_dirty_count < DIRTY_RECT_MAX) break;
+
+		int best = 0;
+		uint32_t best_growth = UINT32_MAX;
+		for (int i=0;i<dev->_dirty_count;i++) {
+			lcd_rect_t u = dev->_dirty[i];
+			lcdRectUnion(&u, &r);
+			uint32_t growth = lcdRectArea(&u) - lcdRectArea(&dev->_dirty[i]);
+			if (growth < best_growth) {
+				best = i;
+				best_growth = growth;
+			}
+		}
+		lcdRectUnion(&r, &dev->_dirty[best]);
+		dev->_dirty[best] = dev->_dirty[--dev->_dirty_count];
+	}
+	dev->_dirty[dev->_dirty_count++] = r;
+}
+
+static uint32_t lcdTilesSize(TFT_t * dev)
+{
+	return ((uint32_t)dev->_tiles_x * dev->_tiles_y + 7) / 8;
+}
+
+static bool lcdTileDirty(TFT_t * dev, const uint8_t * tiles, int tx, int ty)
+{
+	uint32_t bit = ty * dev->_tiles_x + tx;
+	return (tiles[bit >> 3] >> (bit & 7)) & 1;
+}
+
+// Set the bits of the tiles under an area
+static void lcdAddDirtyTiles(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	for (int ty=y1/DIRTY_TILE_SIZE;ty<=y2/DIRTY_TILE_SIZE;ty++) {
+		for (int tx=x1/DIRTY_TILE_SIZE;tx<=x2/DIRTY_TILE_SIZE;tx++) {
+			uint32_t bit = ty * dev->_tiles_x + tx;
+			dev->_dirty_tiles[bit >> 3] |= 1 << (bit & 7);
+		}
+	}
+}
+
+static void lcdAddDirty(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	if (dev->_dirty_mode == LCD_DIRTY_TILES) {
+		lcdAddDirtyTiles(dev, x1, y1, x2, y2);
+	} else {
+		lcdAddDirtyRect(dev, x1, y1, x2, y2);
+	}
+}
+#endif
+
+// Choose how changed areas are tracked
+// mode:LCD_DIRTY_RECTS keeps up to DIRTY_RECT_MAX merged boxes.
+//      LCD_DIRTY_TILES keeps one bit per tile of CONFIG_DIRTY_TILE_SIZE pixels.
+// The next flush sends the whole frame buffer.
+void lcdSetDirtyMode(TFT_t *dev, int mode)
+{
+#if CONFIG_FRAME_BUFFER_DIRTY
+	if (dev->_use_frame_buffer == false) return;
+	if (mode == LCD_DIRTY_TILES && (dev->_dirty_tiles == NULL || dev->_flush_tiles == NULL)) return;
+	LCD_LOCK(dev);
+	dev->_dirty_count = 0;
+	if (dev->_dirty_tiles) memset(dev->_dirty_tiles, 0, lcdTilesSize(dev));
+	dev->_dirty_mode = mode;
+	FB_DIRTY(dev, 0, 0, dev->_width-1, dev->_height-1);
+	LCD_UNLOCK(dev);
+#endif
+}
+
+// Mark an area of the frame buffer to be sent by the next flush.
+// Drawing functions do this themselves, call it after writing to _frame_buffer directly.
+// Without CONFIG_FRAME_BUFFER_DIRTY every flush sends the whole frame buffer.
+void lcdMarkDirty(TFT_t *dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	if (dev->_use_frame_buffer == false) return;
+	if (x1 > x2 || x1 >= dev->_width) return;
+	if (y1 > y2 || y1 >= dev->_height) return;
+	if (x2 >= dev->_width) x2 = dev->_width-1;
+	if (y2 >= dev->_height) y2 = dev->_height-1;
+	LCD_LOCK(dev);
+	FB_DIRTY(dev, x1, y1, x2, y2);
+	LCD_UNLOCK(dev);
+}
+
+// Record a drawing call for band rendering.
+// y1,y2:rows the call draws on, clipped to the screen here
+// Returns false when the call has to be drawn now.
+// If the list is full, what is recorded so far is sent,
+// and drawing goes straight to the panel until the next full screen fill.
+static bool lcdBandRecord(TFT_t * dev, BAND_cmd_t * cmd, int y1, int y2, const void * payload, uint32_t size)
+{
+	if (y2 < 0 || y1 >= dev->_height || y1 > y2) return true;
+	cmd->y1 = (y1 < 0) ? 0 : y1;
+	cmd->y2 = (y2 >= dev->_height) ? dev->_height-1 : y2;
+
+	BAND_t *band = dev->_band;
+	LCD_LOCK(dev);
+	bool recorded = bandAppend(band, cmd, payload, size);
+	if (recorded) {
+		bandMarkRows(band, cmd->y1, cmd->y2);
+	} else {
+		if (band->overflows++ == 0) ESP_LOGW(TAG, "Band command list is full, drawing without it");
+		lcdBandFlush(dev);
+		band->direct = true;
+	}
+	LCD_UNLOCK(dev);
+	return recorded;
+}
+
+// Stop recording until the next full screen fill
+static void lcdBandDirect(TFT_t * dev)
+{
+	LCD_LOCK(dev);
+	lcdBandFlush(dev);
+	dev->_band->direct = true;
+	LCD_UNLOCK(dev);
+}
+
+// Fill an area of the band being rendered
+static void lcdBandFill(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color)
+{
+	BAND_t *band = dev->_band;
+	if (y1 < band->y1) y1 = band->y1;
+	if (y2 > band->y2) y2 = band->y2;
+	uint16_t _color = FB_COLOR(color);
+	for (int j = y1; j <= y2; j++) {
+		uint16_t *row = &band->buffer[(j - band->y1)*dev->_width];
+		for (int i = x1; i <= x2; i++) {
+			row[i] = _color;
+		}
+	}
+}
+
+#if FB_BPP < 8
+// Fill pixels x1 to x2 of row y of a packed frame buffer, whole bytes at once
+static void lcdFillSpan(TFT_t * dev, uint16_t x1, uint16_t x2, uint16_t y, uint8_t pixel)
+{
+	while (x1 <= x2 && x1 % FB_PER_BYTE) {
+		FB_SET(dev, x1, y, pixel);
+		x1++;
+	}
+	uint8_t byte = pixel * ((FB_BPP == 1) ? 0xFF : 0x11);
+	uint16_t bytes = (x2 + 1 - x1) / FB_PER_BYTE;
+	memset(&dev->_frame_buffer[FB_INDEX(dev, x1, y)], byte, bytes);
+	x1 += bytes * FB_PER_BYTE;
+	while (x1 <= x2) {
+		FB_SET(dev, x1, y, pixel);
+		x1++;
+	}
+}
+#endif
 
 // Draw pixel
 // x:X coordinate
@@ -289,21 +896,26 @@ void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
 void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color){
 	if (x >= dev->_width) return;
 	if (y >= dev->_height) return;
+	if (BAND_RECORDING(dev)) {
+		BAND_cmd_t cmd = {.op = BAND_PIXEL, .color = color, .arg = {x, y}};
+		if (lcdBandRecord(dev, &cmd, y, y, NULL, 0)) return;
+	}
 
+	LCD_LOCK(dev);
 	if (dev->_use_frame_buffer) {
-		dev->_frame_buffer[y*dev->_width+x] = color;
+		FB_SET(dev, x, y, FB_PIXEL(dev, color));
+		FB_DIRTY(dev, x, y, x, y);
+	} else if (BAND_REPLAYING(dev)) {
+		lcdBandFill(dev, x, y, x, y, color);
 	} else {
 		uint16_t _x = x + dev->_offsetx;
 		uint16_t _y = y + dev->_offsety;
 
-		spi_master_write_command(dev, 0x2A);	// set column(x) address
-		spi_master_write_addr(dev, _x, _x);
-		spi_master_write_command(dev, 0x2B);	// set Page(y) address
-		spi_master_write_addr(dev, _y, _y);
-		spi_master_write_command(dev, 0x2C);	// Memory Write
+		lcdSetWindow(dev, _x, _y, _x, _y);
 		//spi_master_write_data_word(dev, color);
 		spi_master_write_colors(dev, &color, 1);
 	}
+	LCD_UNLOCK(dev);
 }
 
 
@@ -315,7 +927,12 @@ void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color){
 void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint16_t * colors) {
 	if (x+size > dev->_width) return;
 	if (y >= dev->_height) return;
+	if (BAND_RECORDING(dev)) {
+		BAND_cmd_t cmd = {.op = BAND_PIXELS, .arg = {x, y, size}};
+		if (lcdBandRecord(dev, &cmd, y, y, colors, sizeof(uint16_t)*size)) return;
+	}
 
+	LCD_LOCK(dev);
 	if (dev->_use_frame_buffer) {
 		uint16_t _x1 = x;
 		uint16_t _x2 = _x1 + (size-1);
@@ -324,7 +941,15 @@ void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint
 		int16_t index = 0;
 		for (int16_t j = _y1; j <= _y2; j++){
 			for(int16_t i = _x1; i <= _x2; i++){
-				 dev->_frame_buffer[j*dev->_width+i] = colors[index++];
+				 FB_SET(dev, i, j, FB_PIXEL(dev, colors[index++]));
+			}
+		}
+		FB_DIRTY(dev, _x1, _y1, _x2, _y2);
+	} else if (BAND_REPLAYING(dev)) {
+		if (y >= dev->_band->y1 && y <= dev->_band->y2) {
+			uint16_t *row = &dev->_band->buffer[(y - dev->_band->y1)*dev->_width];
+			for (int i = 0; i < size; i++) {
+				row[x+i] = FB_COLOR(colors[i]);
 			}
 		}
 	} else {
@@ -333,13 +958,10 @@ void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint
 		uint16_t _y1 = y + dev->_offsety;
 		uint16_t _y2 = _y1;
 
-		spi_master_write_command(dev, 0x2A);	// set column(x) address
-		spi_master_write_addr(dev, _x1, _x2);
-		spi_master_write_command(dev, 0x2B);	// set Page(y) address
-		spi_master_write_addr(dev, _y1, _y2);
-		spi_master_write_command(dev, 0x2C);	// Memory Write
+		lcdSetWindow(dev, _x1, _y1, _x2, _y2);
 		spi_master_write_colors(dev, colors, size);
 	}
+	LCD_UNLOCK(dev);
 }
 
 // Draw rectangle of filling
@@ -355,31 +977,127 @@ void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_
 	if (y2 >= dev->_height) y2=dev->_height-1;
 
 	ESP_LOGD(TAG,"offset(x)=%d offset(y)=%d",dev->_offsetx,dev->_offsety);
+	if (dev->_band && dev->_band->replaying == false && x1 == 0 && y1 == 0 && x2 == dev->_width-1 && y2 == dev->_height-1) {
+		// Nothing drawn before shows any more, so recording starts over
+		LCD_LOCK(dev);
+		bandReset(dev->_band, color);
+		bandMarkRows(dev->_band, 0, y2);
+		LCD_UNLOCK(dev);
+		return;
+	}
+	if (BAND_RECORDING(dev)) {
+		BAND_cmd_t cmd = {.op = BAND_FILL_RECT, .color = color, .arg = {x1, y1, x2, y2}};
+		if (lcdBandRecord(dev, &cmd, y1, y2, NULL, 0)) return;
+	}
 
+	LCD_LOCK(dev);
 	if (dev->_use_frame_buffer) {
+		lcd_pixel_t _color = FB_PIXEL(dev, color);
+#if FB_BPP < 8
 		for (int16_t j = y1; j <= y2; j++){
+			lcdFillSpan(dev, x1, x2, j, _color);
+		}
+#else
+		for (int16_t j = y1; j <= y2; j++){
+			lcd_pixel_t *fb = &dev->_frame_buffer[FB_INDEX(dev, 0, j)];
 			for(int16_t i = x1; i <= x2; i++){
-				dev->_frame_buffer[j*dev->_width+i] = color;
+				fb[i] = _color;
 			}
 		}
+#endif
+		FB_DIRTY(dev, x1, y1, x2, y2);
+	} else if (BAND_REPLAYING(dev)) {
+		lcdBandFill(dev, x1, y1, x2, y2, color);
 	} else {
 		uint16_t _x1 = x1 + dev->_offsetx;
 		uint16_t _x2 = x2 + dev->_offsetx;
 		uint16_t _y1 = y1 + dev->_offsety;
 		uint16_t _y2 = y2 + dev->_offsety;
 
-		spi_master_write_command(dev, 0x2A);	// set column(x) address
-		spi_master_write_addr(dev, _x1, _x2);
-		spi_master_write_command(dev, 0x2B);	// set Page(y) address
-		spi_master_write_addr(dev, _y1, _y2);
-		spi_master_write_command(dev, 0x2C);	// Memory Write
-		for(int i=_x1;i<=_x2;i++){
-			uint16_t size = _y2-_y1+1;
-			spi_master_write_color(dev, color, size);
+		lcdSetWindow(dev, _x1, _y1, _x2, _y2);
+		uint32_t size = (uint32_t)(_x2-_x1+1) * (_y2-_y1+1);
+		spi_master_write_color(dev, color, size);
+	}
+	LCD_UNLOCK(dev);
+}
+
+// Open a window for streaming pixels
+// x1:Start X coordinate
+// y1:Start Y coordinate
+// x2:End X coordinate
+// y2:End Y coordinate
+// Pixels pushed by lcdPushPixels fill the window left to right, top to bottom.
+// The window must be on the screen, otherwise it is ignored.
+// With CONFIG_LCD_LOCK the lock is held until lcdEndWindow.
+void lcdBeginWindow(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+	// Streamed pixels are not recorded
+	if (BAND_RECORDING(dev)) lcdBandDirect(dev);
+	LCD_LOCK(dev);
+	// A window left open by this task still holds the lock once
+	if (dev->_stream_active) LCD_UNLOCK(dev);
+	dev->_stream_active = false;
+	if (x1 > x2 || x2 >= dev->_width || y1 > y2 || y2 >= dev->_height) {
+		LCD_UNLOCK(dev);
+		return;
+	}
+
+	dev->_stream_active = true;
+	dev->_stream_x1 = x1;
+	dev->_stream_x2 = x2;
+	dev->_stream_x = x1;
+	dev->_stream_y = y1;
+	dev->_stream_remain = (uint32_t)(x2-x1+1) * (y2-y1+1);
+	if (dev->_use_frame_buffer) {
+		FB_DIRTY(dev, x1, y1, x2, y2);
+	} else {
+		lcdSetWindow(dev, x1 + dev->_offsetx, y1 + dev->_offsety, x2 + dev->_offsetx, y2 + dev->_offsety);
+	}
+}
+
+// Push pixels into the window opened by lcdBeginWindow
+// size:Number of colors. Any length, pixels past the end of the window are dropped.
+// colors:colors
+void lcdPushPixels(TFT_t * dev, uint16_t * colors, uint32_t size) {
+	if (dev->_stream_active == false) return;
+	if (size > dev->_stream_remain) size = dev->_stream_remain;
+	dev->_stream_remain -= size;
+
+	if (dev->_use_frame_buffer) {
+		uint16_t x = dev->_stream_x;
+		uint16_t y = dev->_stream_y;
+#if FB_BPP < 8
+		for (uint32_t i = 0; i < size; i++) {
+			FB_SET(dev, x, y, FB_PIXEL(dev, colors[i]));
+			if (++x > dev->_stream_x2) {
+				x = dev->_stream_x1;
+				y++;
+			}
 		}
+#else
+		lcd_pixel_t *fb = &dev->_frame_buffer[FB_INDEX(dev, 0, y)];
+		for (uint32_t i = 0; i < size; i++) {
+			fb[x] = FB_PIXEL(dev, colors[i]);
+			if (++x > dev->_stream_x2) {
+				x = dev->_stream_x1;
+				y++;
+				if (y < dev->_height) fb = &dev->_frame_buffer[FB_INDEX(dev, 0, y)];
+			}
+		}
+#endif
+		dev->_stream_x = x;
+		dev->_stream_y = y;
+	} else {
+		spi_master_write_pixels(dev, colors, size);
 	}
 }
 
+// Close the window opened by lcdBeginWindow
+void lcdEndWindow(TFT_t * dev) {
+	if (dev->_stream_active == false) return;
+	dev->_stream_active = false;
+	LCD_UNLOCK(dev);
+}
+
 // Draw square of filling
 // x0:Center X coordinate
 // y0:Center Y coordinate
@@ -395,17 +1113,31 @@ void lcdDrawFillSquare(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t size, uin
 
 // Display OFF
 void lcdDisplayOff(TFT_t * dev) {
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
 	spi_master_write_command(dev, 0x28);	// Display off
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
 }
  
 // Display ON
 void lcdDisplayOn(TFT_t * dev) {
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
 	spi_master_write_command(dev, 0x29);	// Display on
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
 }
 
 // Fill screen
 // color:color
 void lcdFillScreen(TFT_t * dev, uint16_t color) {
+#if FB_BPP <= 8
+	// Nothing drawn before is left, so the palette doesn't fill up with old colors
+	if (dev->_use_frame_buffer) lcdResetPalette(dev);
+#endif
 	lcdDrawFillRect(dev, 0, 0, dev->_width-1, dev->_height-1, color);
 }
 
@@ -421,6 +1153,11 @@ void lcdDrawLine(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2
 	int sx,sy;
 	int E;
 
+	if (BAND_RECORDING(dev)) {
+		BAND_cmd_t cmd = {.op = BAND_LINE, .color = color, .arg = {x1, y1, x2, y2}};
+		if (lcdBandRecord(dev, &cmd, (y1 < y2) ? y1 : y2, (y1 < y2) ? y2 : y1, NULL, 0)) return;
+	}
+
 	/* distance between two points */
 	dx = ( x2 > x1 ) ? x2 - x1 : x1 - x2;
 	dy = ( y2 > y1 ) ? y2 - y1 : y1 - y2;
@@ -590,6 +1327,13 @@ void lcdDrawCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t c
 	int err;
 	int old_err;
 
+	if (BAND_RECORDING(dev)) {
+		BAND_cmd_t cmd = {.op = BAND_CIRCLE, .color = color, .arg = {x0, y0, r}};
+		// Above the top, the coordinates wrap through uint16_t and lines can reach the bottom row
+		int y2 = (y0 < r) ? dev->_height-1 : y0+r;
+		if (lcdBandRecord(dev, &cmd, y0-r, y2, NULL, 0)) return;
+	}
+
 	x=0;
 	y=-r;
 	err=2-2*r;
@@ -615,6 +1359,13 @@ void lcdDrawFillCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16
 	int old_err;
 	int ChangeX;
 
+	if (BAND_RECORDING(dev)) {
+		BAND_cmd_t cmd = {.op = BAND_FILL_CIRCLE, .color = color, .arg = {x0, y0, r}};
+		// Above the top, the coordinates wrap through uint16_t and lines can reach the bottom row
+		int y2 = (y0 < r) ? dev->_height-1 : y0+r;
+		if (lcdBandRecord(dev, &cmd, y0-r, y2, NULL, 0)) return;
+	}
+
 	x=0;
 	y=-r;
 	err=2-2*r;
@@ -657,6 +1408,11 @@ void lcdDrawRoundRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16
 	if (x2-x1 < r) return; // Add 20190517
 	if (y2-y1 < r) return; // Add 20190517
 
+	if (BAND_RECORDING(dev)) {
+		BAND_cmd_t cmd = {.op = BAND_ROUND_RECT, .color = color, .arg = {x1, y1, x2, y2, r}};
+		if (lcdBandRecord(dev, &cmd, y1, y2, NULL, 0)) return;
+	}
+
 	x=0;
 	y=-r;
 	err=2-2*r;
@@ -750,6 +1506,51 @@ void lcdDrawFillArrow(TFT_t * dev, uint16_t x0,uint16_t y0,uint16_t x1,uint16_t
 }
 
 
+#if FB_BPP < 8
+// Widest glyph row that fits in 64 bits after the shift to its first pixel
+#define GLYPH_BLIT_WIDTH 56
+
+// Write a glyph of lcdDrawChar in direction 0 straight into a packed frame buffer.
+// Each row of the font pattern is shifted to the bit of its first pixel
+// and merged into the frame buffer one byte at a time, instead of one pixel at a time.
+// The glyph must be entirely on the screen.
+// x0,y0:top left pixel of the glyph
+static void lcdBlitGlyph(TFT_t * dev, const uint8_t * fonts, uint8_t pw, uint8_t ph, uint16_t x0, uint16_t y0, uint16_t color)
+{
+	// Nibble masks of 2 pixels at 4 bits
+	static const uint8_t spread[4] = {0x00, 0x0F, 0xF0, 0xFF};
+	int bytes = (pw+4)/8;
+	int width = (pw < bytes*8) ? pw : bytes*8;
+	int shift = x0 % FB_PER_BYTE;
+	int count = (shift + width + FB_PER_BYTE - 1) / FB_PER_BYTE;
+	uint64_t keep = ~0ULL << (64 - width);
+
+	LCD_LOCK(dev);
+	uint8_t pattern = FB_PIXEL(dev, color) * ((FB_BPP == 1) ? 0xFF : 0x11);
+	const uint8_t *row = fonts;
+	for (int h=0;h<ph;h++) {
+		uint64_t bits = 0;
+		for (int w=0;w<bytes;w++) bits |= (uint64_t)row[w] << (56 - w*8);
+		bits = (bits & keep) >> shift;
+		uint8_t *fb = &dev->_frame_buffer[FB_INDEX(dev, x0, y0+h)];
+		for (int b=0;b<count;b++) {
+			uint8_t mask = (bits >> (64 - FB_PER_BYTE*(b+1))) & ((1 << FB_PER_BYTE) - 1);
+			if (FB_BPP == 4) mask = spread[mask];
+			fb[b] = (fb[b] & ~mask) | (pattern & mask);
+		}
+		row += bytes;
+	}
+	if (dev->_font_underline) {
+		uint8_t pixel = FB_PIXEL(dev, dev->_font_underline_color);
+		for (int h=ph-2;h<ph;h++) {
+			if (h >= 0) lcdFillSpan(dev, x0, x0+width-1, y0+h, pixel);
+		}
+	}
+	FB_DIRTY(dev, x0, y0, x0+width-1, y0+ph-1);
+	LCD_UNLOCK(dev);
+}
+#endif
+
 // Draw ASCII character
 // x:X coordinate
 // y:Y coordinate
@@ -843,8 +1644,31 @@ int lcdDrawChar(TFT_t * dev, FontxFile *fxs, uint16_t x, uint16_t y, uint8_t asc
 		y1	= y;
 	}
 
+	if (BAND_RECORDING(dev)) {
+		// The glyph is read again when the band is rendered
+		BAND_cmd_t cmd = {.op = BAND_CHAR, .color = color, .font = fxs,
+			.arg = {x, y, ascii, dev->_font_direction, dev->_font_fill_color, dev->_font_underline_color}};
+		if (dev->_font_fill) cmd.flags |= BAND_FONT_FILL;
+		if (dev->_font_underline) cmd.flags |= BAND_FONT_UNDERLINE;
+		// Glyphs of direction 2 are drawn upward from y+ph+1
+		int16_t yb = (dev->_font_direction == 2) ? (int16_t)yss : (int16_t)y1;
+		if (lcdBandRecord(dev, &cmd, (int16_t)y0, yb, NULL, 0)) {
+			if (next < 0) next = 0;
+			return next;
+		}
+	}
+
 	if (dev->_font_fill) lcdDrawFillRect(dev, x0, y0, x1, y1, dev->_font_fill_color);
 
+#if FB_BPP < 8
+	// Glyphs narrower than 4 pixels take (pw+4)/8 = 0 bytes a row, the loop below draws nothing of them
+	if (dev->_use_frame_buffer && dev->_font_direction == 0 && pw >= 4 && pw <= GLYPH_BLIT_WIDTH
+		&& y >= ph - 1 && x1 < dev->_width && y1 < dev->_height) {
+		lcdBlitGlyph(dev, fonts, pw, ph, x0, y0, color);
+		return next;
+	}
+#endif
+
 	int bits;
 	if(_DEBUG_)printf("xss=%d yss=%d\n",xss,yss);
 	ofs = 0;
@@ -1005,79 +1829,257 @@ void lcdUnsetFontUnderLine(TFT_t * dev) {
 
 // Backlight OFF
 void lcdBacklightOff(TFT_t * dev) {
-	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 0 );
-	}
+	dev->_ops->backlight(dev, 0);
 }
 
 // Backlight ON
 void lcdBacklightOn(TFT_t * dev) {
-	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 1 );
-	}
+	dev->_ops->backlight(dev, 1);
 }
 
 // Display Inversion Off
 void lcdInversionOff(TFT_t * dev) {
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
 	spi_master_write_command(dev, 0x20); // Display Inversion Off
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
 }
 
 // Display Inversion On
 void lcdInversionOn(TFT_t * dev) {
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
 	spi_master_write_command(dev, 0x21); // Display Inversion On
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
+}
+
+// Hardware vertical scrolling.
+// The panel shows the rows of the scroll area starting at the scroll start, wrapping around at its end.
+// Nothing is moved in the frame memory or in the frame buffer, drawing coordinates stay the same.
+// Use lcdScrollRow to find the row that is shown at a position of the screen.
+
+// Define the scroll area.
+// top:fixed rows at the top of the screen
+// bottom:fixed rows at the bottom of the screen
+// The scroll start goes back to the first row of the area.
+void lcdSetScrollArea(TFT_t * dev, uint16_t top, uint16_t bottom) {
+	if (top + bottom >= dev->_height) return;
+	uint16_t tfa = dev->_offsety + top;
+	uint16_t vsa = dev->_height - top - bottom;
+	// The rows of the frame memory outside the screen belong to the fixed areas
+	uint16_t bfa = (GRAM_HEIGHT > tfa + vsa) ? GRAM_HEIGHT - tfa - vsa : 0;
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
+	spi_master_write_command(dev, 0x33);	// Vertical Scrolling Definition
+	spi_master_write_addr(dev, tfa, vsa);
+	spi_master_write_data_word(dev, bfa);
+	spi_master_write_command(dev, 0x37);	// Vertical Scrolling Start Address
+	spi_master_write_data_word(dev, tfa);
+	dev->_scroll_top = top;
+	dev->_scroll_height = vsa;
+	dev->_scroll_start = 0;
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
+}
+
+// Show the scroll area from one of its rows
+// start:row of the scroll area shown at its top, from 0
+void lcdSetScrollStart(TFT_t * dev, uint16_t start) {
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
+	dev->_scroll_start = start % dev->_scroll_height;
+	spi_master_write_command(dev, 0x37);	// Vertical Scrolling Start Address
+	spi_master_write_data_word(dev, dev->_offsety + dev->_scroll_top + dev->_scroll_start);
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
+}
+
+// Scroll the scroll area like a terminal.
+// lines:rows to scroll, up when positive and down when negative
+// color:color of the rows that come into view
+// Returns the y coordinate of the first row that came into view.
+// They are cleared and sent before the scroll start moves, so no stale rows are shown.
+// When the scroll area is a multiple of lines, they never wrap around and can be drawn like any other rows.
+uint16_t lcdScroll(TFT_t * dev, int lines, uint16_t color) {
+	uint16_t vsa = dev->_scroll_height;
+	uint16_t count = (lines < 0) ? -lines : lines;
+	if (count > vsa) count = vsa;
+	uint16_t start = dev->_scroll_start;
+	uint16_t next = (lines < 0) ? (start + vsa - count) % vsa : (start + count) % vsa;
+	// Scrolling up shows the rows of the old top at the bottom, scrolling down the new top
+	uint16_t first = (lines < 0) ? next : start;
+	uint16_t top = dev->_scroll_top;
+	if (count == 0) return top + first;
+
+	// The rows are split where they wrap around the end of the scroll area
+	lcd_dirty_t rows = {.count = 0, .tiles = NULL};
+	uint16_t end = first + count;
+	if (end > vsa) {
+		rows.rect[rows.count++] = (lcd_rect_t){0, top + first, dev->_width-1, top + vsa - 1};
+		rows.rect[rows.count++] = (lcd_rect_t){0, top, dev->_width-1, top + end - vsa - 1};
+	} else {
+		rows.rect[rows.count++] = (lcd_rect_t){0, top + first, dev->_width-1, top + end - 1};
+	}
+	for (int i=0;i<rows.count;i++) {
+		lcdDrawFillRect(dev, rows.rect[i].x1, rows.rect[i].y1, rows.rect[i].x2, rows.rect[i].y2, color);
+	}
+#if CONFIG_FRAME_BUFFER_DIRTY
+	// Only the changed areas are sent, which are these rows and what was drawn before
+	lcdDrawFinish(dev);
+#else
+	if (dev->_use_frame_buffer) {
+		// Send only these rows, the rest of the frame is on the panel already
+		LCD_LOCK(dev);
+		lcdWaitFlush(dev);
+		FLUSH_LOCK(dev);
+		lcdSendFrame(dev, dev->_frame_buffer, &rows);
+		FLUSH_UNLOCK(dev);
+		LCD_UNLOCK(dev);
+	} else {
+		lcdDrawFinish(dev);
+	}
+#endif
+	lcdSetScrollStart(dev, next);
+	return top + first;
+}
+
+// Row of the frame memory that is shown at row y of the screen
+uint16_t lcdScrollRow(TFT_t * dev, uint16_t y) {
+	uint16_t top = dev->_scroll_top;
+	if (y < top || y >= top + dev->_scroll_height) return y;
+	return top + (y - top + dev->_scroll_start) % dev->_scroll_height;
+}
+
+#if FB_BPP < 8
+// lcdWrapArround of packed pixels, which move one at a time
+static void lcdWrapPacked(TFT_t * dev, SCROLL_TYPE_t scroll, int start, int end)
+{
+	int _width = dev->_width;
+	int _height = dev->_height;
+	uint8_t wk;
+	if (scroll == SCROLL_RIGHT) {
+		for (int y=start;y<end;y++) {
+			wk = FB_GET(dev, _width-1, y);
+			for (int x=_width-1;x>0;x--) FB_SET(dev, x, y, FB_GET(dev, x-1, y));
+			FB_SET(dev, 0, y, wk);
+		}
+		if (start < end) FB_DIRTY(dev, 0, start, _width-1, end-1);
+	} else if (scroll == SCROLL_LEFT) {
+		for (int y=start;y<end;y++) {
+			wk = FB_GET(dev, 0, y);
+			for (int x=0;x<_width-1;x++) FB_SET(dev, x, y, FB_GET(dev, x+1, y));
+			FB_SET(dev, _width-1, y, wk);
+		}
+		if (start < end) FB_DIRTY(dev, 0, start, _width-1, end-1);
+	} else if (scroll == SCROLL_UP) {
+		for (int x=start;x<=end;x++) {
+			wk = FB_GET(dev, x, 0);
+			for (int y=0;y<_height-1;y++) FB_SET(dev, x, y, FB_GET(dev, x, y+1));
+			FB_SET(dev, x, _height-1, wk);
+		}
+		if (start <= end) FB_DIRTY(dev, start, 0, end, _height-1);
+	} else if (scroll == SCROLL_DOWN) {
+		for (int x=start;x<=end;x++) {
+			wk = FB_GET(dev, x, _height-1);
+			for (int y=_height-1;y>0;y--) FB_SET(dev, x, y, FB_GET(dev, x, y-1));
+			FB_SET(dev, x, 0, wk);
+		}
+		if (start <= end) FB_DIRTY(dev, start, 0, end, _height-1);
+	}
+}
+#endif
+
+// Scroll every column of the frame buffer by one row.
+// Only the row origin moves, the whole screen is sent with the next flush.
+// A flush in flight reads the frame buffer or its copy with the old origin, so it is waited for.
+static void lcdMoveOrigin(TFT_t * dev, SCROLL_TYPE_t scroll)
+{
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
+	uint16_t _height = dev->_height;
+	if (scroll == SCROLL_UP) {
+		dev->_fb_origin = (dev->_fb_origin + 1) % _height;
+	} else {
+		dev->_fb_origin = (dev->_fb_origin + _height - 1) % _height;
+	}
+	FB_DIRTY(dev, 0, 0, dev->_width-1, _height-1);
+	FLUSH_UNLOCK(dev);
 }
 
 void lcdWrapArround(TFT_t * dev, SCROLL_TYPE_t scroll, int start, int end) {
 	if (dev->_use_frame_buffer == false) return;
-	
+	if ((scroll == SCROLL_UP || scroll == SCROLL_DOWN) && start <= 0 && end >= dev->_width-1) {
+		LCD_LOCK(dev);
+		lcdMoveOrigin(dev, scroll);
+		LCD_UNLOCK(dev);
+		return;
+	}
+#if FB_BPP < 8
+	LCD_LOCK(dev);
+	lcdWrapPacked(dev, scroll, start, end);
+	LCD_UNLOCK(dev);
+#else
 	int _width = dev->_width;
 	int _height = dev->_height;
 	int32_t index1;
 	int32_t index2;
 
+	LCD_LOCK(dev);
 	if (scroll == SCROLL_RIGHT) {
-		uint16_t wk[_width];
+		lcd_pixel_t wk[_width];
 		for (int i=start;i<end;i++) {
-			index1 = i * _width;
-			memcpy((char *)wk, (char*)&dev->_frame_buffer[index1], _width*2);
+			index1 = FB_INDEX(dev, 0, i);
+			memcpy((char *)wk, (char*)&dev->_frame_buffer[index1], _width*sizeof(lcd_pixel_t));
 			index2 = index1 + _width - 1;
 			dev->_frame_buffer[index1] = dev->_frame_buffer[index2];
-			memcpy((char *)&dev->_frame_buffer[index1+1], (char *)&wk[0], (_width-1)*2);
+			memcpy((char *)&dev->_frame_buffer[index1+1], (char *)&wk[0], (_width-1)*sizeof(lcd_pixel_t));
 		}
+		if (start < end) FB_DIRTY(dev, 0, start, _width-1, end-1);
 	} else if (scroll == SCROLL_LEFT) {
-		uint16_t wk[_width];
+		lcd_pixel_t wk[_width];
 		for (int i=start;i<end;i++) {
-			index1 = i * _width;
-			memcpy((char *)wk, (char*)&dev->_frame_buffer[index1], _width*2);
+			index1 = FB_INDEX(dev, 0, i);
+			memcpy((char *)wk, (char*)&dev->_frame_buffer[index1], _width*sizeof(lcd_pixel_t));
 			index2 = index1 + _width - 1;
 			dev->_frame_buffer[index2] = dev->_frame_buffer[index1];
-			memcpy((char *)&dev->_frame_buffer[index1], (char *)&wk[1], (_width-1)*2);
+			memcpy((char *)&dev->_frame_buffer[index1], (char *)&wk[1], (_width-1)*sizeof(lcd_pixel_t));
 		}
+		if (start < end) FB_DIRTY(dev, 0, start, _width-1, end-1);
 	} else if (scroll == SCROLL_UP) {
-		uint16_t wk;
+		lcd_pixel_t wk;
 		for (int i=start;i<=end;i++) {
-			wk = dev->_frame_buffer[i];
+			wk = dev->_frame_buffer[FB_INDEX(dev, i, 0)];
 			for (int j=0;j<_height-1;j++) {
-				index1 = j * _width + i;
-				index2 = (j+1) * _width + i;
+				index1 = FB_INDEX(dev, i, j);
+				index2 = FB_INDEX(dev, i, j+1);
 				dev->_frame_buffer[index1] = dev->_frame_buffer[index2];
 			}
-			index2 = (_height-1) * _width + i;
+			index2 = FB_INDEX(dev, i, _height-1);
 			dev->_frame_buffer[index2] = wk;
 		}
+		if (start <= end) FB_DIRTY(dev, start, 0, end, _height-1);
 	} else if (scroll == SCROLL_DOWN) {
-		uint16_t wk;
+		lcd_pixel_t wk;
 		for (int i=start;i<=end;i++) {
-			index2 = (_height-1) * _width + i;
+			index2 = FB_INDEX(dev, i, _height-1);
 			wk = dev->_frame_buffer[index2];
 			for (int j=_height-2;j>=0;j--) {
-				index1 = j * _width + i;
-				index2 = (j+1) * _width + i;
+				index1 = FB_INDEX(dev, i, j);
+				index2 = FB_INDEX(dev, i, j+1);
 				dev->_frame_buffer[index2] = dev->_frame_buffer[index1];
 			}
-			dev->_frame_buffer[i] = wk;
+			dev->_frame_buffer[FB_INDEX(dev, i, 0)] = wk;
 		}
+		if (start <= end) FB_DIRTY(dev, start, 0, end, _height-1);
 	}
+	LCD_UNLOCK(dev);
+#endif
 }
 
 // Invert a rectangular area
@@ -1095,12 +2097,16 @@ void lcdInversionArea(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16
 	int index = 0;
 	ESP_LOGD(TAG,"offset(x)=%d offset(y)=%d",dev->_offsetx,dev->_offsety);
 	if (dev->_use_frame_buffer) {
+		LCD_LOCK(dev);
 		for (int16_t j = y1; j <= y2; j++){
 			for(int16_t i = x1; i <= x2; i++){
-				if (save) save[index++] = dev->_frame_buffer[j*dev->_width+i];
-				dev->_frame_buffer[j*dev->_width+i] = ~dev->_frame_buffer[j*dev->_width+i];
+				uint16_t color = FB_RGB(dev, FB_GET(dev, i, j));
+				if (save) save[index++] = color;
+				FB_SET(dev, i, j, FB_PIXEL(dev, ~color));
 			}
 		}
+		FB_DIRTY(dev, x1, y1, x2, y2);
+		LCD_UNLOCK(dev);
 	} else {
 		ESP_LOGW(TAG,"To use this feature, enable the FrameBuffer option.");
 	}
@@ -1121,11 +2127,13 @@ void lcdGetRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2,
 	int index = 0;
 	ESP_LOGD(TAG,"offset(x)=%d offset(y)=%d",dev->_offsetx,dev->_offsety);
 	if (dev->_use_frame_buffer) {
+		LCD_LOCK(dev);
 		for (int16_t j = y1; j <= y2; j++){
 			for(int16_t i = x1; i <= x2; i++){
-				save[index++] = dev->_frame_buffer[j*dev->_width+i];
+				save[index++] = FB_RGB(dev, FB_GET(dev, i, j));
 			}
 		}
+		LCD_UNLOCK(dev);
 	} else {
 		ESP_LOGW(TAG,"Disable frame buffer");
 	}
@@ -1146,11 +2154,14 @@ void lcdSetRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2,
 	int index = 0;
 	ESP_LOGD(TAG,"offset(x)=%d offset(y)=%d",dev->_offsetx,dev->_offsety);
 	if (dev->_use_frame_buffer) {
+		LCD_LOCK(dev);
 		for (int16_t j = y1; j <= y2; j++){
 			for(int16_t i = x1; i <= x2; i++){
-				dev->_frame_buffer[j*dev->_width+i] = save[index++];
+				FB_SET(dev, i, j, FB_PIXEL(dev, save[index++]));
 			}
 		}
+		FB_DIRTY(dev, x1, y1, x2, y2);
+		LCD_UNLOCK(dev);
 	} else {
 		ESP_LOGW(TAG,"Disable frame buffer");
 	}
@@ -1171,26 +2182,539 @@ void lcdResetCursor(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t
 	//lcdDrawCircle(dev, x0, y0, r, color);
 }
 
+// Take the areas to send with the next flush.
+// Without CONFIG_FRAME_BUFFER_DIRTY it is the whole frame.
+static void lcdTakeDirty(TFT_t *dev, lcd_dirty_t *dirty)
+{
+	dirty->tiles = NULL;
+#if CONFIG_FRAME_BUFFER_DIRTY
+	if (dev->_dirty_mode == LCD_DIRTY_TILES) {
+		// The flush reads this bitmap, new changes go to the other one
+		uint8_t *tiles = dev->_flush_tiles;
+		dev->_flush_tiles = dev->_dirty_tiles;
+		dev->_dirty_tiles = tiles;
+		uint32_t size = lcdTilesSize(dev);
+		memset(dev->_dirty_tiles, 0, size);
+		dirty->count = 0;
+		for (uint32_t i=0;i<size;i++) {
+			if (dev->_flush_tiles[i]) {
+				dirty->tiles = dev->_flush_tiles;
+				break;
+			}
+		}
+		return;
+	}
+	dirty->count = dev->_dirty_count;
+	memcpy(dirty->rect, dev->_dirty, sizeof(lcd_rect_t)*dirty->count);
+	dev->_dirty_count = 0;
+#else
+	dirty->rect[0].x1 = 0;
+	dirty->rect[0].y1 = 0;
+	dirty->rect[0].x2 = dev->_width-1;
+	dirty->rect[0].y2 = dev->_height-1;
+	dirty->count = 1;
+#endif
+}
+
+typedef void (*lcd_area_fn_t)(TFT_t *dev, lcd_pixel_t *buffer, const lcd_rect_t *r);
+
+#if CONFIG_FRAME_BUFFER_DIRTY
+// Pass an area in tile units to fn in pixels
+static void lcdTileArea(TFT_t *dev, const lcd_rect_t *t, lcd_area_fn_t fn, lcd_pixel_t *buffer)
+{
+	lcd_rect_t r;
+	r.x1 = t->x1 * DIRTY_TILE_SIZE;
+	r.y1 = t->y1 * DIRTY_TILE_SIZE;
+	r.x2 = (t->x2 + 1) * DIRTY_TILE_SIZE - 1;
+	r.y2 = (t->y2 + 1) * DIRTY_TILE_SIZE - 1;
+	if (r.x2 >= dev->_width) r.x2 = dev->_width-1;
+	if (r.y2 >= dev->_height) r.y2 = dev->_height-1;
+	fn(dev, buffer, &r);
+}
+
+// Coalesce dirty tiles into areas.
+// Dirty tiles of a tile row form runs, bridging up to DIRTY_TILE_GAP clean tiles.
+// A run over the same columns as a run of the row above extends that area downwards.
+static void lcdForEachTileArea(TFT_t *dev, const uint8_t *tiles, lcd_area_fn_t fn, lcd_pixel_t *buffer)
+{
+	int tiles_x = dev->_tiles_x;
+	lcd_rect_t *open = dev->_tile_runs;
+	lcd_rect_t *run = dev->_tile_runs + DIRTY_RUNS_MAX(tiles_x);
+	int open_count = 0;
+	for (int ty=0;ty<dev->_tiles_y;ty++) {
+		int run_count = 0;
+		int tx = 0;
+		while (tx < tiles_x) {
+			if (lcdTileDirty(dev, tiles, tx, ty) == false) {
+				tx++;
+				continue;
+			}
+			int end = tx;
+			for (int x=tx+1;x<tiles_x && x<=end+DIRTY_TILE_GAP+1;x++) {
+				if (lcdTileDirty(dev, tiles, x, ty)) end = x;
+			}
+			run[run_count].x1 = tx;
+			run[run_count].y1 = ty;
+			run[run_count].x2 = end;
+			run[run_count].y2 = ty;
+			run_count++;
+			tx = end + 1;
+		}
+
+		for (int i=0;i<open_count;i++) {
+			bool extended = false;
+			for (int j=0;j<run_count;j++) {
+				if (run[j].x1 != open[i].x1 || run[j].x2 != open[i].x2) continue;
+				run[j].y1 = open[i].y1;
+				extended = true;
+				break;
+			}
+			if (extended == false) lcdTileArea(dev, &open[i], fn, buffer);
+		}
+		memcpy(open, run, sizeof(lcd_rect_t)*run_count);
+		open_count = run_count;
+	}
+	for (int i=0;i<open_count;i++) {
+		lcdTileArea(dev, &open[i], fn, buffer);
+	}
+}
+#endif
+
+static void lcdForEachDirty(TFT_t *dev, const lcd_dirty_t *dirty, lcd_area_fn_t fn, lcd_pixel_t *buffer)
+{
+#if CONFIG_FRAME_BUFFER_DIRTY
+	if (dirty->tiles) {
+		lcdForEachTileArea(dev, dirty->tiles, fn, buffer);
+		return;
+	}
+#endif
+	for (int i=0;i<dirty->count;i++) {
+		fn(dev, buffer, &dirty->rect[i]);
+	}
+}
+
+static bool lcdIsDirty(const lcd_dirty_t *dirty)
+{
+	return dirty->count != 0 || dirty->tiles != NULL;
+}
+
+#if CONFIG_LCD_LOCK || defined(ESP_PLATFORM)
+// Copy an area of the frame buffer into the snapshot
+// Packed pixels are copied by whole bytes, which may take a few pixels beside the area.
+static void lcdCopyRect(TFT_t *dev, lcd_pixel_t *dst, const lcd_pixel_t *src, const lcd_rect_t *r)
+{
+	uint16_t width = r->x2 - r->x1 + 1;
+	if (width == dev->_width) {
+		// Rows follow each other up to the end of the frame buffer
+		for (int y=r->y1;y<=r->y2;) {
+			uint32_t row = FB_ROW(dev, y);
+			uint32_t n = r->y2 - y + 1;
+			if (n > dev->_height - row) n = dev->_height - row;
+			uint32_t offset = row * FB_STRIDE(dev);
+			memcpy(&dst[offset], &src[offset], sizeof(lcd_pixel_t)*FB_STRIDE(dev)*n);
+			y += n;
+		}
+		return;
+	}
+	uint32_t count = FB_INDEX(dev, r->x2, 0) - FB_INDEX(dev, r->x1, 0) + 1;
+	for (int y=r->y1;y<=r->y2;y++) {
+		uint32_t offset = FB_INDEX(dev, r->x1, y);
+		memcpy(&dst[offset], &src[offset], sizeof(lcd_pixel_t)*count);
+	}
+}
+
+// Copy an area of the frame buffer into buffer
+static void lcdCopyArea(TFT_t *dev, lcd_pixel_t *buffer, const lcd_rect_t *r)
+{
+	lcdCopyRect(dev, buffer, dev->_frame_buffer, r);
+}
+
+#if CONFIG_FRAME_BUFFER_COPY_FORWARD
+// Copy an area of buffer into the frame buffer
+static void lcdCopyForward(TFT_t *dev, lcd_pixel_t *buffer, const lcd_rect_t *r)
+{
+	lcdCopyRect(dev, dev->_frame_buffer, buffer, r);
+}
+#endif
+#endif
+
+static void lcdSendPixels(TFT_t *dev, uint16_t *buffer, uint32_t size)
+{
+#if CONFIG_FRAME_BUFFER_NATIVE
+	// Already in the panel byte order. DMA reads the buffer directly.
+	spi_master_write_data(dev, (uint8_t *)buffer, size*2);
+#else
+	spi_master_write_pixels(dev, buffer, size);
+#endif
+}
+
+// Send pixels of a frame buffer
+static void lcdSendFramePixels(TFT_t *dev, lcd_pixel_t *buffer, uint32_t size)
+{
+#if FB_BPP < 8
+	spi_master_write_packed(dev, buffer, FB_BPP, dev->_lut, size);
+#elif FB_BPP == 8
+	// Expanded by the transport while it copies them
+	spi_master_write_indexed(dev, buffer, dev->_palette, size);
+#else
+	lcdSendPixels(dev, buffer, size);
+#endif
+}
+
+// Send an area of a frame
+// Rows of an area that spans the whole width go in one transfer.
+// On a shared bus the area goes in chunks of FLUSH_CHUNK_LINES lines,
+// and waiters of the same or a higher priority get the bus between chunks.
+static void lcdSendArea(TFT_t *dev, lcd_pixel_t *buffer, const lcd_rect_t *area)
+{
+#if FB_BPP < 8
+	// Packed rows are sent from the start of a byte.
+	// The pixels added on the left are current in buffer, see lcdCopyRect.
+	lcd_rect_t aligned = *area;
+	aligned.x1 -= aligned.x1 % FB_PER_BYTE;
+	const lcd_rect_t *r = &aligned;
+	// Rows padded to a byte can't go in one transfer
+	bool rows = (dev->_width % FB_PER_BYTE) == 0;
+#else
+	const lcd_rect_t *r = area;
+	bool rows = true;
+#endif
+	lcdSetWindow(dev, r->x1+dev->_offsetx, r->y1+dev->_offsety, r->x2+dev->_offsetx, r->y2+dev->_offsety);
+	uint16_t width = r->x2 - r->x1 + 1;
+	int lines = dev->_shared ? FLUSH_CHUNK_LINES : r->y2 - r->y1 + 1;
+	for (int y=r->y1;y<=r->y2;) {
+		int n = (r->y2 - y + 1 < lines) ? r->y2 - y + 1 : lines;
+		if (rows && width == dev->_width) {
+			// Whole rows go in up to two pieces, split where they wrap around the end of the frame buffer
+			uint32_t row = FB_ROW(dev, y);
+			if (n > dev->_height - row) n = dev->_height - row;
+			lcdSendFramePixels(dev, &buffer[FB_INDEX(dev, 0, y)], (uint32_t)width*n);
+		} else {
+			for (int k=0;k<n;k++) {
+				lcdSendFramePixels(dev, &buffer[FB_INDEX(dev, r->x1, y+k)], width);
+			}
+		}
+		if (dev->_shared && busShouldYield(dev->_shared)) {
+			// The panel keeps its write position while CS is high
+			lcdSync(dev);
+			busYield(dev->_shared);
+		}
+		y += n;
+	}
+}
+
+// Send the dirty areas of a frame
+// buffer:frame buffer or a copy of it
+static void lcdSendFrame(TFT_t *dev, lcd_pixel_t *buffer, const lcd_dirty_t *dirty)
+{
+	if (lcdIsDirty(dirty) == false) return;
+	if (dev->_shared) busTake(dev->_shared, dev->_priority);
+	lcdForEachDirty(dev, dirty, lcdSendArea, buffer);
+#if CONFIG_FRAME_BUFFER_NATIVE
+	lcdSync(dev);
+#endif
+	if (dev->_shared) {
+		lcdSync(dev);
+		busGive(dev->_shared);
+	}
+}
+
+// Draw a recorded call into the band being rendered
+static void lcdBandReplay(TFT_t *dev, BAND_cmd_t *cmd)
+{
+	uint16_t *a = cmd->arg;
+	switch (cmd->op) {
+	case BAND_PIXEL:
+		lcdDrawPixel(dev, a[0], a[1], cmd->color);
+		break;
+	case BAND_PIXELS:
+		lcdDrawMultiPixels(dev, a[0], a[1], a[2], (uint16_t *)(cmd + 1));
+		break;
+	case BAND_FILL_RECT:
+		lcdDrawFillRect(dev, a[0], a[1], a[2], a[3], cmd->color);
+		break;
+	case BAND_LINE:
+		lcdDrawLine(dev, a[0], a[1], a[2], a[3], cmd->color);
+		break;
+	case BAND_CIRCLE:
+		lcdDrawCircle(dev, a[0], a[1], a[2], cmd->color);
+		break;
+	case BAND_FILL_CIRCLE:
+		lcdDrawFillCircle(dev, a[0], a[1], a[2], cmd->color);
+		break;
+	case BAND_ROUND_RECT:
+		lcdDrawRoundRect(dev, a[0], a[1], a[2], a[3], a[4], cmd->color);
+		break;
+	case BAND_CHAR: {
+		// Font settings of the time of the call
+		uint16_t direction = dev->_font_direction;
+		uint16_t fill = dev->_font_fill;
+		uint16_t fill_color = dev->_font_fill_color;
+		uint16_t underline = dev->_font_underline;
+		uint16_t underline_color = dev->_font_underline_color;
+		dev->_font_direction = a[3];
+		dev->_font_fill = (cmd->flags & BAND_FONT_FILL) != 0;
+		dev->_font_fill_color = a[4];
+		dev->_font_underline = (cmd->flags & BAND_FONT_UNDERLINE) != 0;
+		dev->_font_underline_color = a[5];
+		lcdDrawChar(dev, cmd->font, a[0], a[1], a[2], cmd->color);
+		dev->_font_direction = direction;
+		dev->_font_fill = fill;
+		dev->_font_fill_color = fill_color;
+		dev->_font_underline = underline;
+		dev->_font_underline_color = underline_color;
+		break;
+	}
+	}
+}
+
+// Render and send the bands that changed since the last flush
+static void lcdBandFlush(TFT_t *dev)
+{
+	BAND_t *band = dev->_band;
+	if (bandDirty(band) == false) return;
+
+	FLUSH_LOCK(dev);
+	for (int y=0;y<dev->_height;y+=band->lines) {
+		if ((band->dirty & ((uint64_t)1 << (y / band->lines))) == 0) continue;
+		band->y1 = y;
+		band->y2 = (y + band->lines - 1 < dev->_height) ? y + band->lines - 1 : dev->_height-1;
+		uint32_t size = (uint32_t)dev->_width * (band->y2 - band->y1 + 1);
+		uint16_t background = FB_COLOR(band->background);
+		for (uint32_t i=0;i<size;i++) {
+			band->buffer[i] = background;
+		}
+		band->replaying = true;
+		for (BAND_cmd_t *cmd=bandNext(band, NULL);cmd;cmd=bandNext(band, cmd)) {
+			if (cmd->y2 < band->y1 || cmd->y1 > band->y2) continue;
+			lcdBandReplay(dev, cmd);
+		}
+		band->replaying = false;
+
+		// Other devices on a shared bus get it between bands
+		if (dev->_shared) busTake(dev->_shared, dev->_priority);
+		lcdSetWindow(dev, dev->_offsetx, band->y1+dev->_offsety, dev->_width-1+dev->_offsetx, band->y2+dev->_offsety);
+		lcdSendPixels(dev, band->buffer, size);
+#if CONFIG_FRAME_BUFFER_NATIVE
+		// The band buffer is sent without a copy
+		lcdSync(dev);
+#endif
+		if (dev->_shared) {
+			lcdSync(dev);
+			busGive(dev->_shared);
+		}
+	}
+	bandClean(band);
+	FLUSH_UNLOCK(dev);
+}
+
+#if CONFIG_LCD_LOCK || defined(ESP_PLATFORM)
+// Allocate the copy of the frame buffer at the first use
+static bool lcdAllocSnapshot(TFT_t *dev)
+{
+	if (dev->_snapshot) return true;
+	// Internal RAM when there is room, PSRAM only if the frame buffer is there too
+	uint8_t placed;
+	int placement = (dev->_fb_placement == LCD_FB_PSRAM) ? LCD_FB_AUTO : LCD_FB_INTERNAL;
+	dev->_snapshot = lcdAllocFrame(dev, placement, &placed);
+	if (dev->_snapshot == NULL) {
+		ESP_LOGW(TAG, "No memory for a copy of the frame buffer");
+		return false;
+	}
+	return true;
+}
+#endif
+
+// Arbitrate frame flushes with other devices on the SPI bus of dev.
+// Everything else on the bus must use busTake and busGive of the same BUS_t.
+// bus:shared bus set up with busInit, NULL to stop sharing
+// priority:priority of the flushes, see lcdSetFlushPriority
+void lcdShareBus(TFT_t *dev, BUS_t *bus, int priority)
+{
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	dev->_shared = bus;
+	dev->_priority = priority;
+	LCD_UNLOCK(dev);
+}
+
+// Priority hint of the following flushes.
+// BUS_PRIORITY_UI flushes finish before bulk transfers get the bus,
+// BUS_PRIORITY_BULK flushes let every waiter in between chunks.
+void lcdSetFlushPriority(TFT_t *dev, int priority)
+{
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	dev->_priority = priority;
+	LCD_UNLOCK(dev);
+}
+
 // Draw Frame Buffer
 void lcdDrawFinish(TFT_t *dev)
 {
+	if (dev->_band) {
+		LCD_LOCK(dev);
+		lcdBandFlush(dev);
+		LCD_UNLOCK(dev);
+		return;
+	}
 	if (dev->_use_frame_buffer == false) return;
-
-	spi_master_write_command(dev, 0x2A); // set column(x) address
-	spi_master_write_addr(dev, dev->_offsetx, dev->_offsetx+dev->_width-1);
-	spi_master_write_command(dev, 0x2B); // set Page(y) address
-	spi_master_write_addr(dev, dev->_offsety, dev->_offsety+dev->_height-1);
-	spi_master_write_command(dev, 0x2C); // Memory Write
-
-	//uint16_t size = dev->_width*dev->_height;
-	uint32_t size = dev->_width*dev->_height;
-	uint16_t *image = dev->_frame_buffer;
-	while (size > 0) {
-		// 1024 bytes per time.
-		uint16_t bs = (size > 1024) ? 1024 : size;
-		spi_master_write_colors(dev, image, bs);
-		size -= bs;
-		image += bs;
+#ifdef ESP_PLATFORM
+	if (dev->_double) {
+		// Returns once the frame buffers are swapped
+		lcdDrawFinishAsync(dev, NULL, NULL);
+		return;
 	}
+#endif
+
+	lcd_dirty_t dirty;
+	LCD_LOCK(dev);
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
+	lcdTakeDirty(dev, &dirty);
+	lcdSendFrame(dev, dev->_frame_buffer, &dirty);
+	FLUSH_UNLOCK(dev);
+	LCD_UNLOCK(dev);
 	return;
 }
+
+// Draw Frame Buffer from a copy
+// The frame buffer is copied under the lock, so other tasks can draw while the copy is sent.
+// Without CONFIG_LCD_LOCK this is the same as lcdDrawFinish.
+void lcdDrawFinishSnapshot(TFT_t *dev)
+{
+#if CONFIG_LCD_LOCK
+	if (dev->_use_frame_buffer == false) {
+		lcdDrawFinish(dev);
+		return;
+	}
+
+	LCD_LOCK(dev);
+	if (lcdAllocSnapshot(dev) == false) {
+		lcdDrawFinish(dev);
+		LCD_UNLOCK(dev);
+		return;
+	}
+	// The copy is reused once the previous flush has been sent
+	lcd_dirty_t dirty;
+	lcdWaitFlush(dev);
+	FLUSH_LOCK(dev);
+	lcdTakeDirty(dev, &dirty);
+	lcdForEachDirty(dev, &dirty, lcdCopyArea, dev->_snapshot);
+	LCD_UNLOCK(dev);
+
+	lcdSendFrame(dev, dev->_snapshot, &dirty);
+	FLUSH_UNLOCK(dev);
+#else
+	lcdDrawFinish(dev);
+#endif
+}
+
+#ifdef ESP_PLATFORM
+// Send the copies queued by lcdDrawFinishAsync
+static void lcdFlushTask(void *pvParameters)
+{
+	TFT_t * dev = pvParameters;
+	while(1) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		FLUSH_LOCK(dev);
+		lcdSendFrame(dev, dev->_snapshot, &dev->_flush_dirty);
+		lcdSync(dev);
+		FLUSH_UNLOCK(dev);
+
+		lcd_flush_cb_t callback = dev->_flush_cb;
+		void *arg = dev->_flush_arg;
+		xSemaphoreGive(dev->_flush_idle);
+		if (callback) callback(dev, arg);
+	}
+}
+#endif
+
+// Draw Frame Buffer without waiting
+// The frame buffer is copied and the copy is sent by a flush task, then callback(dev, arg) is called from that task.
+// Drawing during the flush goes to the frame buffer and appears with the next flush.
+// A flush started while another one is in flight waits for it first.
+// If the copy can't be allocated, the frame buffer is sent before returning.
+// Don't call it between lcdBeginBurst and lcdEndBurst, the flush task can't send while the bus is held.
+// callback:Called when the transfer is finished. It may be NULL.
+void lcdDrawFinishAsync(TFT_t *dev, lcd_flush_cb_t callback, void *arg)
+{
+	if (dev->_use_frame_buffer == false) {
+		lcdDrawFinish(dev);
+		if (callback) callback(dev, arg);
+		return;
+	}
+
+#ifdef ESP_PLATFORM
+	LCD_LOCK(dev);
+	if (lcdAllocSnapshot(dev) == false) {
+		lcdDrawFinish(dev);
+		LCD_UNLOCK(dev);
+		if (callback) callback(dev, arg);
+		return;
+	}
+	if (dev->_flush_task == NULL) {
+		BaseType_t ret = xTaskCreatePinnedToCore(lcdFlushTask, "LCD_FLUSH", 1024*3, dev, uxTaskPriorityGet(NULL), &dev->_flush_task, FLUSH_TASK_CORE);
+		assert(ret==pdPASS);
+	}
+
+	// Held by the flush task until the transfer is finished
+	xSemaphoreTake(dev->_flush_idle, portMAX_DELAY);
+	FLUSH_LOCK(dev);
+	lcdTakeDirty(dev, &dev->_flush_dirty);
+	if (dev->_double) {
+		// The frame buffer becomes the one to send and drawing goes on in the other one
+		lcd_pixel_t *front = dev->_frame_buffer;
+		dev->_frame_buffer = dev->_snapshot;
+		dev->_snapshot = front;
+	} else {
+		lcdForEachDirty(dev, &dev->_flush_dirty, lcdCopyArea, dev->_snapshot);
+	}
+	FLUSH_UNLOCK(dev);
+	dev->_flush_cb = callback;
+	dev->_flush_arg = arg;
+	xTaskNotifyGive(dev->_flush_task);
+#if CONFIG_FRAME_BUFFER_COPY_FORWARD
+	// The back buffer holds the frame before, so only the areas sent now differ.
+	// They are copied while the flush task reads the same areas.
+	if (dev->_double) lcdForEachDirty(dev, &dev->_flush_dirty, lcdCopyForward, dev->_snapshot);
+#endif
+	LCD_UNLOCK(dev);
+#else
+	lcdDrawFinish(dev);
+	if (callback) callback(dev, arg);
+#endif
+}
+
+// Wait until the flush started by lcdDrawFinishAsync is finished
+void lcdWaitFlush(TFT_t *dev)
+{
+#ifdef ESP_PLATFORM
+	if (dev->_flush_task == NULL) return;
+	xSemaphoreTake(dev->_flush_idle, portMAX_DELAY);
+	xSemaphoreGive(dev->_flush_idle);
+#endif
+}
+
+// Read the SPI traffic counters
+// commands:Commands sent
+// transactions:Data transactions
+// pixel_bytes:Bytes of pixel data
+// window_sets:Address windows set with CASET or RASET
+// blocked_us:Time waiting for the SPI driver
+// Without CONFIG_LCD_STATS all counters are 0.
+void lcdGetStats(TFT_t *dev, lcd_stats_t *stats)
+{
+#if CONFIG_LCD_STATS
+	*stats = dev->_stats;
+#else
+	memset(stats, 0, sizeof(lcd_stats_t));
+#endif
+}
+
+void lcdResetStats(TFT_t *dev)
+{
+#if CONFIG_LCD_STATS
+	memset(&dev->_stats, 0, sizeof(lcd_stats_t));
+#endif
+}
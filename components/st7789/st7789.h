@@ -1,8 +1,20 @@
 #ifndef MAIN_ST7789_H_
 #define MAIN_ST7789_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
 #include "driver/spi_master.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#endif
 #include "fontx.h"
+#include "st7789_bus.h"
+#include "st7789_band.h"
 
 #define rgb565(r, g, b) (((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3))
 
@@ -16,6 +28,12 @@
 #define CYAN   rgb565(  0, 156, 209) // 0x04FA
 #define PURPLE rgb565(128,   0, 128) // 0x8010
 
+#define SPI_QUEUE_SIZE 7
+#define BOUNCE_BUFFER_MAX 4
+#define DIRTY_RECT_MAX 8
+// Rows of the frame memory of the ST7796S, which vertical scrolling divides up
+#define GRAM_HEIGHT 480
+
 typedef enum {DIRECTION0, DIRECTION90, DIRECTION180, DIRECTION270} DIRECTION;
 
 typedef enum {
@@ -25,7 +43,95 @@ typedef enum {
 	SCROLL_UP = 4,
 } SCROLL_TYPE_t;
 
+typedef struct TFT_t TFT_t;
+
+// Element of the frame buffer.
+// FB_BPP is the bits per pixel. Up to 8 bits, pixels are indices into the palette of the TFT_t.
+// 1 and 4 bit pixels are packed into bytes, the leftmost pixel in the most significant bits.
+// LUT_SIZE is the size of the table that expands packed pixels, see lcdUnpackPixels.
+#if CONFIG_FRAME_BUFFER_MONO
+typedef uint8_t lcd_pixel_t;
+#define FB_BPP 1
+#define PALETTE_SIZE 2
+#define LUT_SIZE (16*4*2)
+#elif CONFIG_FRAME_BUFFER_INDEXED4
+typedef uint8_t lcd_pixel_t;
+#define FB_BPP 4
+#define PALETTE_SIZE 16
+#define LUT_SIZE (256*2*2)
+#elif CONFIG_FRAME_BUFFER_INDEXED
+typedef uint8_t lcd_pixel_t;
+#define FB_BPP 8
+#define PALETTE_SIZE 256
+#else
+typedef uint16_t lcd_pixel_t;
+#define FB_BPP 16
+#endif
+#define PALETTE_CACHE_SIZE 64
+
+// Area of the frame buffer. The end coordinates are included.
+typedef struct {
+	uint16_t x1;
+	uint16_t y1;
+	uint16_t x2;
+	uint16_t y2;
+} lcd_rect_t;
+
+// How changed areas of the frame buffer are tracked, see lcdSetDirtyMode
+typedef enum {
+	LCD_DIRTY_RECTS = 0,
+	LCD_DIRTY_TILES = 1,
+} LCD_DIRTY_MODE_t;
+
+// Where the frame buffer is allocated, see lcdPlaceFrameBuffer
+typedef enum {
+	LCD_FB_AUTO = 0,
+	LCD_FB_INTERNAL = 1,
+	LCD_FB_PSRAM = 2,
+} LCD_FB_PLACEMENT_t;
+
+// Areas sent by one flush.
+// Either up to DIRTY_RECT_MAX rectangles, or the tiles set in a bitmap when tiles is not NULL.
+typedef struct {
+	lcd_rect_t rect[DIRTY_RECT_MAX];
+	uint8_t count;
+	uint8_t *tiles;
+} lcd_dirty_t;
+
+// SPI traffic of one TFT_t, see lcdGetStats
+typedef struct {
+	uint32_t commands;
+	uint32_t transactions;
+	uint32_t pixel_bytes;
+	uint32_t window_sets;
+	int64_t blocked_us;
+} lcd_stats_t;
+
+#if CONFIG_LCD_STATS
+#define LCD_STATS_ADD(dev, field, n) ((dev)->_stats.field += (n))
+#else
+#define LCD_STATS_ADD(dev, field, n) do { } while (0)
+#endif
+
+// Called when lcdDrawFinishAsync has sent the frame
+typedef void (*lcd_flush_cb_t)(TFT_t * dev, void * arg);
+
+// Transport backend.
+// write_data copies up to 4 bytes. Longer data must stay untouched until flush returns.
+// write_indexed sends palette[index[i]] for each index.
+// write_packed sends 1 or 4 bit pixels expanded by lcdUnpackPixels.
 typedef struct {
+	bool (*write_command)(TFT_t * dev, uint8_t cmd);
+	bool (*write_data)(TFT_t * dev, const uint8_t * data, uint32_t length);
+	bool (*write_pixels)(TFT_t * dev, const uint16_t * colors, uint32_t size);
+	bool (*write_indexed)(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size);
+	bool (*write_packed)(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size);
+	bool (*write_color)(TFT_t * dev, uint16_t color, uint32_t size);
+	void (*flush)(TFT_t * dev);
+	void (*backlight)(TFT_t * dev, int level);
+} TFT_ops_t;
+
+struct TFT_t {
 	uint16_t _width;
 	uint16_t _height;
 	uint16_t _offsetx;
@@ -35,28 +141,130 @@ typedef struct {
 	uint16_t _font_fill_color;
 	uint16_t _font_underline;
 	uint16_t _font_underline_color;
+	uint16_t _scroll_top;
+	uint16_t _scroll_height;
+	uint16_t _scroll_start;
 	int16_t _dc;
 	int16_t _bl;
+	const TFT_ops_t *_ops;
+	void *_bus;
+#ifdef ESP_PLATFORM
+	spi_host_device_t _host;
 	spi_device_handle_t _SPIHandle;
+	spi_device_handle_t _SPIControl;
+	spi_device_handle_t _SPIPixel;
+	int _clock_speed_hz;
+	int _pixel_clock_hz;
+	int16_t _cs;
+	int16_t _cs_manual;
+	bool _ramwr;
+	spi_transaction_t _trans[SPI_QUEUE_SIZE];
+	uint32_t _trans_queued;
+	uint32_t _trans_done;
+	uint8_t _trans_head;
+	uint32_t _max_transfer;
+	bool _burst;
+	uint8_t *_bounce[BOUNCE_BUFFER_MAX];
+	uint32_t _bounce_seq[BOUNCE_BUFFER_MAX];
+	uint8_t _bounce_count;
+	uint8_t _bounce_index;
+	uint16_t _bounce_size;
+	uint8_t *_fill;
+	uint32_t _fill_seq;
+	uint16_t _fill_size;
+	uint16_t _fill_color;
+	bool _fill_valid;
+#endif
+	bool _win_valid;
+	uint16_t _win_x1;
+	uint16_t _win_x2;
+	uint16_t _win_y1;
+	uint16_t _win_y2;
+	uint32_t _win_pos;
+	bool _stream_active;
+	uint16_t _stream_x1;
+	uint16_t _stream_x2;
+	uint16_t _stream_x;
+	uint16_t _stream_y;
+	uint32_t _stream_remain;
 	bool _use_frame_buffer;
-	uint16_t *_frame_buffer;
-} TFT_t;
+	lcd_pixel_t *_frame_buffer;
+	uint8_t _fb_placement;
+	uint16_t _fb_origin;
+#if FB_BPP <= 8
+	uint16_t _palette[PALETTE_SIZE];
+	uint16_t _palette_count;
+	uint8_t _palette_cache[PALETTE_CACHE_SIZE];
+#endif
+#if FB_BPP < 8
+	uint8_t _lut[LUT_SIZE];
+#endif
+#if CONFIG_FRAME_BUFFER_DIRTY
+	uint8_t _dirty_mode;
+	lcd_rect_t _dirty[DIRTY_RECT_MAX];
+	uint8_t _dirty_count;
+	uint8_t *_dirty_tiles;
+	uint8_t *_flush_tiles;
+	lcd_rect_t *_tile_runs;
+	uint16_t _tiles_x;
+	uint16_t _tiles_y;
+#endif
+#if CONFIG_LCD_LOCK
+	SemaphoreHandle_t _lock;
+	SemaphoreHandle_t _flush_lock;
+#endif
+	lcd_pixel_t *_snapshot;
+	BUS_t *_shared;
+	uint8_t _priority;
+	BAND_t *_band;
+#if CONFIG_LCD_STATS
+	lcd_stats_t _stats;
+#endif
+#ifdef ESP_PLATFORM
+	TaskHandle_t _flush_task;
+	SemaphoreHandle_t _flush_idle;
+	lcd_flush_cb_t _flush_cb;
+	void *_flush_arg;
+	lcd_dirty_t _flush_dirty;
+	bool _double;
+#endif
+};
 
+#ifdef ESP_PLATFORM
 void spi_clock_speed(int speed);
+void spi_pixel_clock_speed(int speed);
 void spi_master_init(TFT_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL);
+void spi_master_init_host(TFT_t * dev, spi_host_device_t host, int speed, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL);
+void spi_master_add_device(TFT_t * dev, spi_host_device_t host, int speed, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL);
+void spi_master_set_pixel_clock(TFT_t * dev, int speed);
 bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength);
+bool spi_master_queue_byte(TFT_t * dev, const uint8_t* Data, size_t DataLength, int dc);
+void lcdBeginBurst(TFT_t * dev);
+void lcdEndBurst(TFT_t * dev);
+#endif
+void spi_master_sync(TFT_t * dev);
+bool spi_master_write_data(TFT_t * dev, const uint8_t * Data, uint32_t DataLength);
 bool spi_master_write_command(TFT_t * dev, uint8_t cmd);
 bool spi_master_write_data_byte(TFT_t * dev, uint8_t data);
 bool spi_master_write_data_word(TFT_t * dev, uint16_t data);
 bool spi_master_write_addr(TFT_t * dev, uint16_t addr1, uint16_t addr2);
-bool spi_master_write_color(TFT_t * dev, uint16_t color, uint16_t size);
+bool spi_master_write_color(TFT_t * dev, uint16_t color, uint32_t size);
 bool spi_master_write_colors(TFT_t * dev, uint16_t * colors, uint16_t size);
+bool spi_master_write_pixels(TFT_t * dev, const uint16_t * colors, uint32_t size);
+bool spi_master_write_indexed(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size);
+bool spi_master_write_packed(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size);
+void lcdUnpackPixels(const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t first, uint32_t count, uint8_t * out);
 
 void delayMS(int ms);
+void lcdClearHandles(TFT_t * dev);
+void lcdInitState(TFT_t * dev, int width, int height, int offsetx, int offsety);
 void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety);
 void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color);
 void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint16_t * colors);
 void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color);
+void lcdBeginWindow(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+void lcdPushPixels(TFT_t * dev, uint16_t * colors, uint32_t size);
+void lcdEndWindow(TFT_t * dev);
 void lcdDrawFillSquare(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t size, uint16_t color);
 void lcdDisplayOff(TFT_t * dev);
 void lcdDisplayOn(TFT_t * dev);
@@ -86,11 +294,28 @@ void lcdBacklightOn(TFT_t * dev);
 void lcdInversionOff(TFT_t * dev);
 void lcdInversionOn(TFT_t * dev);
 void lcdWrapArround(TFT_t * dev, SCROLL_TYPE_t scroll, int start, int end);
+void lcdSetScrollArea(TFT_t * dev, uint16_t top, uint16_t bottom);
+void lcdSetScrollStart(TFT_t * dev, uint16_t start);
+uint16_t lcdScroll(TFT_t * dev, int lines, uint16_t color);
+uint16_t lcdScrollRow(TFT_t * dev, uint16_t y);
 void lcdInversionArea(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t *save);
 void lcdGetRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t *save);
 void lcdSetRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t *save);
 void lcdSetCursor(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t color, uint16_t *save);
 void lcdResetCursor(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t color, uint16_t *save);
+void lcdSetDirtyMode(TFT_t *dev, int mode);
+bool lcdPlaceFrameBuffer(TFT_t *dev, int placement);
+uint8_t lcdPaletteIndex(TFT_t *dev, uint16_t color);
+void lcdSetPalette(TFT_t *dev, uint8_t first, uint16_t count, const uint16_t *colors);
+void lcdResetPalette(TFT_t *dev);
+void lcdMarkDirty(TFT_t *dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
 void lcdDrawFinish(TFT_t *dev);
+void lcdDrawFinishSnapshot(TFT_t *dev);
+void lcdDrawFinishAsync(TFT_t *dev, lcd_flush_cb_t callback, void *arg);
+void lcdWaitFlush(TFT_t *dev);
+void lcdShareBus(TFT_t *dev, BUS_t *bus, int priority);
+void lcdSetFlushPriority(TFT_t *dev, int priority);
+void lcdGetStats(TFT_t *dev, lcd_stats_t *stats);
+void lcdResetStats(TFT_t *dev);
 #endif /* MAIN_ST7789_H_ */
 
@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "st7789_band.h"
+
+// Commands are kept aligned for the font pointer
+#define BAND_ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+// buffer:band buffer of lines rows
+// list:memory for the commands
+void bandInit(BAND_t * band, uint16_t * buffer, uint16_t lines, uint8_t * list, uint32_t size)
+{
+	memset(band, 0, sizeof(BAND_t));
+	band->buffer = buffer;
+	band->lines = lines;
+	band->list = list;
+	band->size = size;
+	bandReset(band, 0);
+	bandClean(band);
+}
+
+// Forget all commands. The screen is background until something is drawn.
+void bandReset(BAND_t * band, uint16_t background)
+{
+	band->used = 0;
+	band->count = 0;
+	band->background = background;
+	band->direct = false;
+}
+
+// Add a command and its payload to the list.
+// Returns false when the list is full.
+bool bandAppend(BAND_t * band, BAND_cmd_t * cmd, const void * payload, uint32_t size)
+{
+	uint32_t length = BAND_ALIGN(sizeof(BAND_cmd_t) + size);
+	if (length > UINT16_MAX || band->used + length > band->size) return false;
+	cmd->length = length;
+	memcpy(&band->list[band->used], cmd, sizeof(BAND_cmd_t));
+	if (size) memcpy(&band->list[band->used + sizeof(BAND_cmd_t)], payload, size);
+	band->used += length;
+	band->count++;
+	return true;
+}
+
+// Walk the list. cmd:NULL for the first command
+// Returns NULL after the last command.
+BAND_cmd_t * bandNext(BAND_t * band, BAND_cmd_t * cmd)
+{
+	uint32_t offset = cmd ? (uint8_t *)cmd - band->list + cmd->length : 0;
+	if (offset >= band->used) return NULL;
+	return (BAND_cmd_t *)&band->list[offset];
+}
+
+// Rows to render again with the next flush
+void bandMarkRows(BAND_t * band, uint16_t y1, uint16_t y2)
+{
+	for (int i=y1/band->lines;i<=y2/band->lines;i++) {
+		band->dirty |= (uint64_t)1 << i;
+	}
+}
+
+// Nothing to render
+void bandClean(BAND_t * band)
+{
+	band->dirty = 0;
+}
+
+bool bandDirty(BAND_t * band)
+{
+	return band->dirty != 0;
+}
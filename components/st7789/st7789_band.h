@@ -0,0 +1,67 @@
+#ifndef MAIN_ST7789_BAND_H_
+#define MAIN_ST7789_BAND_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Band rendering for panels whose frame buffer does not fit in RAM.
+// Drawing calls are recorded into a command list instead of being drawn.
+// At flush the screen is rendered band by band: the band buffer is cleared,
+// the commands that touch the band are replayed into it, and it is sent.
+// The list holds everything drawn since the last full screen fill,
+// so any band can be rendered again.
+
+typedef enum {
+	BAND_PIXEL = 0,
+	BAND_PIXELS = 1,
+	BAND_FILL_RECT = 2,
+	BAND_LINE = 3,
+	BAND_CIRCLE = 4,
+	BAND_FILL_CIRCLE = 5,
+	BAND_ROUND_RECT = 6,
+	BAND_CHAR = 7,
+} BAND_OP_t;
+
+// Bands of a screen, one bit each in the dirty mask
+#define BAND_MAX 64
+
+// Flags of BAND_CHAR
+#define BAND_FONT_FILL 0x01
+#define BAND_FONT_UNDERLINE 0x02
+
+// One recorded drawing call. Colors of BAND_PIXELS follow it in the list.
+typedef struct {
+	uint8_t op;
+	uint8_t flags;
+	uint16_t length;
+	uint16_t y1;
+	uint16_t y2;
+	uint16_t color;
+	uint16_t arg[6];
+	void *font;
+} BAND_cmd_t;
+
+typedef struct {
+	uint16_t *buffer;
+	uint16_t lines;
+	uint16_t y1;
+	uint16_t y2;
+	uint8_t *list;
+	uint32_t size;
+	uint32_t used;
+	uint16_t count;
+	uint16_t background;
+	bool replaying;
+	bool direct;
+	uint64_t dirty;
+	uint32_t overflows;
+} BAND_t;
+
+void bandInit(BAND_t * band, uint16_t * buffer, uint16_t lines, uint8_t * list, uint32_t size);
+void bandReset(BAND_t * band, uint16_t background);
+bool bandAppend(BAND_t * band, BAND_cmd_t * cmd, const void * payload, uint32_t size);
+BAND_cmd_t * bandNext(BAND_t * band, BAND_cmd_t * cmd);
+void bandMarkRows(BAND_t * band, uint16_t y1, uint16_t y2);
+void bandClean(BAND_t * band);
+bool bandDirty(BAND_t * band);
+#endif /* MAIN_ST7789_BAND_H_ */
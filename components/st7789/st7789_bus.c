@@ -0,0 +1,125 @@
+#include <string.h>
+#include <assert.h>
+
+#include "st7789_bus.h"
+
+void busInit(BUS_t * bus)
+{
+	memset(bus, 0, sizeof(BUS_t));
+	bus->_owner = BUS_FREE;
+#ifdef ESP_PLATFORM
+	bus->_mutex = xSemaphoreCreateMutex();
+	assert(bus->_mutex != NULL);
+	for (int i=0;i<BUS_PRIORITY_COUNT;i++) {
+		bus->_wake[i] = xSemaphoreCreateCounting(UINT8_MAX, 0);
+		assert(bus->_wake[i] != NULL);
+	}
+#endif
+}
+
+// Ask for the bus.
+// Returns true when it is free and now owned at priority.
+// Otherwise the caller is counted as a waiter until busHandOver picks it.
+bool busRequest(BUS_t * bus, int priority)
+{
+	assert(priority >= 0 && priority < BUS_PRIORITY_COUNT);
+	if (bus->_owner == BUS_FREE) {
+		bus->_owner = priority;
+		bus->grants[priority]++;
+		return true;
+	}
+	bus->_waiting[priority]++;
+	return false;
+}
+
+// Pass the bus from the owner to the waiter with the highest priority.
+// Returns the priority of the new owner, or BUS_FREE when nobody waits.
+int busHandOver(BUS_t * bus)
+{
+	for (int i=BUS_PRIORITY_COUNT-1;i>=0;i--) {
+		if (bus->_waiting[i] == 0) continue;
+		bus->_waiting[i]--;
+		bus->_owner = i;
+		bus->grants[i]++;
+		return i;
+	}
+	bus->_owner = BUS_FREE;
+	return BUS_FREE;
+}
+
+// True when someone waits with at least the priority of the owner.
+// Waiters of the same priority take turns, lower ones wait until the owner is done.
+bool busShouldYield(BUS_t * bus)
+{
+	if (bus->_owner == BUS_FREE) return false;
+	for (int i=bus->_owner;i<BUS_PRIORITY_COUNT;i++) {
+		if (bus->_waiting[i]) return true;
+	}
+	return false;
+}
+
+// Take the bus, waiting for it if needed
+void busTake(BUS_t * bus, int priority)
+{
+#ifdef ESP_PLATFORM
+	xSemaphoreTake(bus->_mutex, portMAX_DELAY);
+	bool granted = busRequest(bus, priority);
+	xSemaphoreGive(bus->_mutex);
+	// busGive of the owner hands the bus over and wakes us
+	if (granted == false) xSemaphoreTake(bus->_wake[priority], portMAX_DELAY);
+#else
+	// Nothing else runs on a host, so the owner and the waiters ahead of us are mock devices.
+	// The mock uses the bus and gives it back until it comes to us.
+	// Waiters of the same priority are served in turn, so count their grants.
+	if (busRequest(bus, priority)) return;
+	uint32_t turn = bus->grants[priority] + bus->_waiting[priority];
+	while ((int32_t)(bus->grants[priority] - turn) < 0) {
+		assert(bus->_mock != NULL);
+		bus->_mock(bus->_mock_arg);
+	}
+#endif
+}
+
+// Give the bus back
+void busGive(BUS_t * bus)
+{
+#ifdef ESP_PLATFORM
+	xSemaphoreTake(bus->_mutex, portMAX_DELAY);
+	int next = busHandOver(bus);
+	xSemaphoreGive(bus->_mutex);
+	if (next != BUS_FREE) xSemaphoreGive(bus->_wake[next]);
+#else
+	busHandOver(bus);
+#endif
+}
+
+// Let a waiter use the bus and take it back afterwards.
+// Returns false without giving the bus when nobody with enough priority waits.
+bool busYield(BUS_t * bus)
+{
+#ifdef ESP_PLATFORM
+	xSemaphoreTake(bus->_mutex, portMAX_DELAY);
+	bool yield = busShouldYield(bus);
+	int priority = bus->_owner;
+	if (yield) bus->yields++;
+	xSemaphoreGive(bus->_mutex);
+#else
+	bool yield = busShouldYield(bus);
+	int priority = bus->_owner;
+	if (yield) bus->yields++;
+#endif
+	if (yield == false) return false;
+	busGive(bus);
+	busTake(bus, priority);
+	return true;
+}
+
+#ifndef ESP_PLATFORM
+// Set the mock devices of a host test.
+// busTake calls mock while the bus is owned by one of them, and mock must give it back with busGive.
+void busSetMock(BUS_t * bus, void (*mock)(void * arg), void * arg)
+{
+	bus->_mock = mock;
+	bus->_mock_arg = arg;
+}
+#endif
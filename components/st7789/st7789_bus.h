@@ -0,0 +1,51 @@
+#ifndef MAIN_ST7789_BUS_H_
+#define MAIN_ST7789_BUS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#endif
+
+// Cooperative arbitration of an SPI bus that is shared with other devices such as an SD card.
+// Every user of the bus takes it with busTake and gives it back with busGive.
+// When the bus is given back, the waiter with the highest priority gets it next.
+// busRequest, busHandOver and busShouldYield hold the arbitration rules without blocking,
+// so they can be checked on a host with a mock device.
+// On a host, busTake runs the mock of busSetMock while another device owns the bus.
+
+typedef enum {
+	BUS_PRIORITY_BULK = 0,
+	BUS_PRIORITY_NORMAL = 1,
+	BUS_PRIORITY_UI = 2,
+} BUS_PRIORITY_t;
+
+#define BUS_PRIORITY_COUNT 3
+#define BUS_FREE -1
+
+typedef struct {
+	int8_t _owner;
+	uint8_t _waiting[BUS_PRIORITY_COUNT];
+	uint32_t grants[BUS_PRIORITY_COUNT];
+	uint32_t yields;
+#ifdef ESP_PLATFORM
+	SemaphoreHandle_t _mutex;
+	SemaphoreHandle_t _wake[BUS_PRIORITY_COUNT];
+#else
+	void (*_mock)(void * arg);
+	void * _mock_arg;
+#endif
+} BUS_t;
+
+void busInit(BUS_t * bus);
+bool busRequest(BUS_t * bus, int priority);
+int busHandOver(BUS_t * bus);
+bool busShouldYield(BUS_t * bus);
+void busTake(BUS_t * bus, int priority);
+void busGive(BUS_t * bus);
+bool busYield(BUS_t * bus);
+#ifndef ESP_PLATFORM
+void busSetMock(BUS_t * bus, void (*mock)(void * arg), void * arg);
+#endif
+#endif /* MAIN_ST7789_BUS_H_ */
@@ -0,0 +1,318 @@
+#include <string.h>
+#include <assert.h>
+
+#include "st7789_canvas.h"
+
+static bool canvas_write_command(TFT_t * dev, uint8_t cmd);
+static bool canvas_write_data(TFT_t * dev, const uint8_t * data, uint32_t length);
+static bool canvas_write_pixels(TFT_t * dev, const uint16_t * colors, uint32_t size);
+static bool canvas_write_indexed(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size);
+static bool canvas_write_packed(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size);
+static bool canvas_write_color(TFT_t * dev, uint16_t color, uint32_t size);
+static void canvas_flush(TFT_t * dev);
+static void canvas_backlight(TFT_t * dev, int level);
+
+static const TFT_ops_t canvas_ops = {
+	.write_command = canvas_write_command,
+	.write_data = canvas_write_data,
+	.write_pixels = canvas_write_pixels,
+	.write_indexed = canvas_write_indexed,
+	.write_packed = canvas_write_packed,
+	.write_color = canvas_write_color,
+	.flush = canvas_flush,
+	.backlight = canvas_backlight,
+};
+
+// Make dev a canvas without panels.
+// Call lcdInit(dev, ...) after all panels are added.
+void canvasInit(TFT_t * dev, CANVAS_t * canvas)
+{
+	memset(canvas, 0, sizeof(CANVAS_t));
+	dev->_ops = &canvas_ops;
+	dev->_bus = canvas;
+	dev->_dc = -1;
+	dev->_bl = -1;
+#ifdef ESP_PLATFORM
+	dev->_SPIHandle = NULL;
+	dev->_clock_speed_hz = 0;
+	dev->_burst = false;
+#endif
+	lcdClearHandles(dev);
+}
+
+// Place a panel on the canvas.
+// panel must already be connected to its bus (spi_master_init and friends).
+// x,y:position of the panel on the canvas
+// width,height,offsetx,offsety:same as lcdInit of the panel
+void canvasAddPanel(TFT_t * dev, TFT_t * panel, uint16_t x, uint16_t y, int width, int height, int offsetx, int offsety)
+{
+	CANVAS_t *canvas = dev->_bus;
+	assert(canvas->_count < CANVAS_PANEL_MAX);
+	CANVAS_panel_t *p = &canvas->_panel[canvas->_count++];
+	p->panel = panel;
+	p->x = x;
+	p->y = y;
+	p->width = width;
+	p->height = height;
+	p->active = false;
+
+	lcdInitState(panel, width, height, offsetx, offsety);
+	panel->_use_frame_buffer = false;
+	panel->_frame_buffer = NULL;
+}
+
+static void canvas_broadcast_command(CANVAS_t * canvas, uint8_t cmd)
+{
+	for (int i=0;i<canvas->_count;i++) {
+		spi_master_write_command(canvas->_panel[i].panel, cmd);
+	}
+}
+
+// Open the part of the canvas window that lies on each panel
+static void canvas_begin_write(TFT_t * dev, CANVAS_t * canvas)
+{
+	uint16_t xs = canvas->_xs - dev->_offsetx;
+	uint16_t xe = canvas->_xe - dev->_offsetx;
+	uint16_t ys = canvas->_ys - dev->_offsety;
+	uint16_t ye = canvas->_ye - dev->_offsety;
+	for (int i=0;i<canvas->_count;i++) {
+		CANVAS_panel_t *p = &canvas->_panel[i];
+		p->active = false;
+		if (xe < p->x || xs >= p->x + p->width) continue;
+		if (ye < p->y || ys >= p->y + p->height) continue;
+		uint16_t x1 = (xs > p->x ? xs : p->x) - p->x;
+		uint16_t x2 = (xe < p->x + p->width - 1 ? xe : p->x + p->width - 1) - p->x;
+		uint16_t y1 = (ys > p->y ? ys : p->y) - p->y;
+		uint16_t y2 = (ye < p->y + p->height - 1 ? ye : p->y + p->height - 1) - p->y;
+		TFT_t *panel = p->panel;
+		spi_master_write_command(panel, 0x2A);	// set column(x) address
+		spi_master_write_addr(panel, x1 + panel->_offsetx, x2 + panel->_offsetx);
+		spi_master_write_command(panel, 0x2B);	// set Page(y) address
+		spi_master_write_addr(panel, y1 + panel->_offsety, y2 + panel->_offsety);
+		spi_master_write_command(panel, 0x2C);	// Memory Write
+		p->active = true;
+	}
+	canvas->_x = canvas->_xs;
+	canvas->_y = canvas->_ys;
+}
+
+static bool canvas_write_command(TFT_t * dev, uint8_t cmd)
+{
+	CANVAS_t *canvas = dev->_bus;
+	canvas->_cmd = cmd;
+	canvas->_nparam = 0;
+	canvas->_ramwr = false;
+
+	switch (cmd) {
+	case 0x2A: // Column Address Set
+	case 0x2B: // Row Address Set
+		// Each panel gets its own clipped window on Memory Write
+		break;
+	case 0x2C: // Memory Write
+		canvas_begin_write(dev, canvas);
+		canvas->_ramwr = true;
+		break;
+	case 0x3C: // Memory Write Continue
+		for (int i=0;i<canvas->_count;i++) {
+			if (canvas->_panel[i].active) spi_master_write_command(canvas->_panel[i].panel, cmd);
+		}
+		canvas->_ramwr = true;
+		break;
+	default:
+		canvas_broadcast_command(canvas, cmd);
+		break;
+	}
+	return true;
+}
+
+// Find where the next pixels of the canvas window go.
+// Returns the panel index, or -1 when they fall outside every panel.
+// *run is the number of pixels that go to the same place.
+static int canvas_next_run(TFT_t * dev, CANVAS_t * canvas, uint32_t size, uint32_t * run)
+{
+	if (canvas->_y > canvas->_ye) {
+		*run = size;
+		return -1;
+	}
+
+	uint16_t x = canvas->_x - dev->_offsetx;
+	uint16_t y = canvas->_y - dev->_offsety;
+	uint32_t left = canvas->_xe - canvas->_x + 1;
+	int index = -1;
+	for (int i=0;i<canvas->_count;i++) {
+		CANVAS_panel_t *p = &canvas->_panel[i];
+		if (y < p->y || y >= p->y + p->height) continue;
+		if (x >= p->x && x < p->x + p->width) {
+			index = i;
+			if (p->x + p->width - x < left) left = p->x + p->width - x;
+			break;
+		}
+	}
+	if (index < 0) {
+		// Skip up to the next panel on this row
+		for (int i=0;i<canvas->_count;i++) {
+			CANVAS_panel_t *p = &canvas->_panel[i];
+			if (y < p->y || y >= p->y + p->height) continue;
+			if (p->x > x && p->x - x < left) left = p->x - x;
+		}
+	}
+
+	*run = (size < left) ? size : left;
+	canvas->_x += *run;
+	if (canvas->_x > canvas->_xe) {
+		canvas->_x = canvas->_xs;
+		canvas->_y++;
+	}
+	return index;
+}
+
+static bool canvas_write_data(TFT_t * dev, const uint8_t * data, uint32_t length)
+{
+	CANVAS_t *canvas = dev->_bus;
+	if (canvas->_ramwr) {
+		// Pixel data. The dispatch layer never splits a pixel.
+		uint32_t size = length / 2;
+		while (size > 0) {
+			uint32_t run;
+			int index = canvas_next_run(dev, canvas, size, &run);
+			if (index >= 0) spi_master_write_data(canvas->_panel[index].panel, data, run*2);
+			data += run*2;
+			size -= run;
+		}
+		return true;
+	}
+
+	if (canvas->_cmd == 0x2A || canvas->_cmd == 0x2B) {
+		for (uint32_t i=0;i<length && canvas->_nparam<sizeof(canvas->_param);i++) {
+			canvas->_param[canvas->_nparam++] = data[i];
+		}
+		if (canvas->_nparam == 4) {
+			uint8_t *p = canvas->_param;
+			if (canvas->_cmd == 0x2A) {
+				canvas->_xs = (p[0] << 8) | p[1];
+				canvas->_xe = (p[2] << 8) | p[3];
+			} else {
+				canvas->_ys = (p[0] << 8) | p[1];
+				canvas->_ye = (p[2] << 8) | p[3];
+			}
+		}
+		return true;
+	}
+
+	// Parameters of every other command go to all panels
+	for (int i=0;i<canvas->_count;i++) {
+		spi_master_write_data(canvas->_panel[i].panel, data, length);
+	}
+	return true;
+}
+
+static bool canvas_write_pixels(TFT_t * dev, const uint16_t * colors, uint32_t size)
+{
+	CANVAS_t *canvas = dev->_bus;
+	if (canvas->_ramwr == false) return true;
+	while (size > 0) {
+		uint32_t run;
+		int index = canvas_next_run(dev, canvas, size, &run);
+		if (index >= 0) spi_master_write_pixels(canvas->_panel[index].panel, colors, run);
+		colors += run;
+		size -= run;
+	}
+	return true;
+}
+
+static bool canvas_write_indexed(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size)
+{
+	CANVAS_t *canvas = dev->_bus;
+	if (canvas->_ramwr == false) return true;
+	while (size > 0) {
+		uint32_t run;
+		int panel = canvas_next_run(dev, canvas, size, &run);
+		if (panel >= 0) spi_master_write_indexed(canvas->_panel[panel].panel, index, palette, run);
+		index += run;
+		size -= run;
+	}
+	return true;
+}
+
+// Runs don't start on a byte of data, so they are expanded here
+// and sent to the panels as colors, which copy them before returning.
+static bool canvas_write_packed(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size)
+{
+	CANVAS_t *canvas = dev->_bus;
+	if (canvas->_ramwr == false) return true;
+	uint8_t bytes[CANVAS_UNPACK_SIZE*2];
+	uint16_t colors[CANVAS_UNPACK_SIZE];
+	uint32_t pos = 0;
+	while (pos < size) {
+		uint32_t run;
+		int panel = canvas_next_run(dev, canvas, size - pos, &run);
+		for (uint32_t done=0;panel>=0 && done<run;) {
+			uint32_t n = (run - done > CANVAS_UNPACK_SIZE) ? CANVAS_UNPACK_SIZE : run - done;
+			lcdUnpackPixels(data, bpp, lut, pos + done, n, bytes);
+			for (int i=0;i<n;i++) colors[i] = (bytes[i*2] << 8) | bytes[i*2+1];
+			spi_master_write_pixels(canvas->_panel[panel].panel, colors, n);
+			done += n;
+		}
+		pos += run;
+	}
+	return true;
+}
+
+static bool canvas_write_color(TFT_t * dev, uint16_t color, uint32_t size)
+{
+	CANVAS_t *canvas = dev->_bus;
+	if (canvas->_ramwr == false) return true;
+	uint32_t row = canvas->_xe - canvas->_xs + 1;
+	while (size > 0) {
+		if (canvas->_x == canvas->_xs && size >= row && canvas->_y <= canvas->_ye) {
+			// Whole rows: one write per panel for as many rows as no panel edge is crossed
+			uint16_t xs = canvas->_xs - dev->_offsetx;
+			uint16_t xe = canvas->_xe - dev->_offsetx;
+			uint16_t y = canvas->_y - dev->_offsety;
+			uint32_t rows = size / row;
+			if (rows > canvas->_ye - canvas->_y + 1) rows = canvas->_ye - canvas->_y + 1;
+			for (int i=0;i<canvas->_count;i++) {
+				CANVAS_panel_t *p = &canvas->_panel[i];
+				if (y >= p->y && y < p->y + p->height) {
+					if (p->y + p->height - y < rows) rows = p->y + p->height - y;
+				} else if (p->y > y && p->y - y < rows) {
+					rows = p->y - y;
+				}
+			}
+			for (int i=0;i<canvas->_count;i++) {
+				CANVAS_panel_t *p = &canvas->_panel[i];
+				if (y < p->y || y >= p->y + p->height) continue;
+				if (xe < p->x || xs >= p->x + p->width) continue;
+				uint16_t x1 = (xs > p->x) ? xs : p->x;
+				uint16_t x2 = (xe < p->x + p->width - 1) ? xe : p->x + p->width - 1;
+				spi_master_write_color(p->panel, color, rows * (x2 - x1 + 1));
+			}
+			canvas->_y += rows;
+			size -= rows * row;
+			continue;
+		}
+		uint32_t run;
+		int index = canvas_next_run(dev, canvas, size, &run);
+		if (index >= 0) spi_master_write_color(canvas->_panel[index].panel, color, run);
+		size -= run;
+	}
+	return true;
+}
+
+// Panels on different hosts transfer in parallel until here
+static void canvas_flush(TFT_t * dev)
+{
+	CANVAS_t *canvas = dev->_bus;
+	for (int i=0;i<canvas->_count;i++) {
+		spi_master_sync(canvas->_panel[i].panel);
+	}
+}
+
+static void canvas_backlight(TFT_t * dev, int level)
+{
+	CANVAS_t *canvas = dev->_bus;
+	for (int i=0;i<canvas->_count;i++) {
+		TFT_t *panel = canvas->_panel[i].panel;
+		panel->_ops->backlight(panel, level);
+	}
+}
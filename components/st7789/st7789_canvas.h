@@ -0,0 +1,40 @@
+#ifndef MAIN_ST7789_CANVAS_H_
+#define MAIN_ST7789_CANVAS_H_
+
+#include "st7789.h"
+
+// One drawing surface made of several panels.
+// The canvas TFT_t splits address windows and pixel data by panel
+// and sends each slice to the TFT_t of that panel.
+
+#define CANVAS_PANEL_MAX 4
+// Pixels expanded at a time from a packed frame buffer
+#define CANVAS_UNPACK_SIZE 64
+
+typedef struct {
+	TFT_t *panel;
+	uint16_t x;
+	uint16_t y;
+	uint16_t width;
+	uint16_t height;
+	bool active;
+} CANVAS_panel_t;
+
+typedef struct {
+	CANVAS_panel_t _panel[CANVAS_PANEL_MAX];
+	uint8_t _count;
+	uint8_t _cmd;
+	uint8_t _nparam;
+	uint8_t _param[4];
+	bool _ramwr;
+	uint16_t _xs;
+	uint16_t _xe;
+	uint16_t _ys;
+	uint16_t _ye;
+	uint16_t _x;
+	uint16_t _y;
+} CANVAS_t;
+
+void canvasInit(TFT_t * dev, CANVAS_t * canvas);
+void canvasAddPanel(TFT_t * dev, TFT_t * panel, uint16_t x, uint16_t y, int width, int height, int offsetx, int offsety);
+#endif /* MAIN_ST7789_CANVAS_H_ */
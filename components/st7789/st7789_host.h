@@ -0,0 +1,26 @@
+#ifndef MAIN_ST7789_HOST_H_
+#define MAIN_ST7789_HOST_H_
+
+// Minimal stand-ins for the ESP-IDF calls used by st7789.c.
+// This allows the drawing code to be compiled on a host together with st7796s_emu.c.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define ESP_LOGE(tag, format, ...) printf("E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) printf("W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) printf("I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { } while (0)
+
+#define MALLOC_CAP_DMA 0
+#define MALLOC_CAP_8BIT 0
+#define MALLOC_CAP_SPIRAM 0
+#define heap_caps_malloc(size, caps) malloc(size)
+#define heap_caps_free(ptr) free(ptr)
+
+typedef uint32_t TickType_t;
+#define portTICK_PERIOD_MS ((TickType_t)10)
+#define vTaskDelay(ticks) ((void)(ticks))
+
+#endif /* MAIN_ST7789_HOST_H_ */
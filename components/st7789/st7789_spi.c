@@ -0,0 +1,660 @@
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <driver/spi_master.h>
+#include <driver/gpio.h>
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_idf_version.h"
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include "esp_memory_utils.h"
+#else
+#include "soc/soc_memory_layout.h"
+#endif
+
+#include "st7789.h"
+
+#define TAG "ST7789"
+
+#if 0
+#ifdef CONFIG_IDF_TARGET_ESP32
+#define LCD_HOST HSPI_HOST
+#elif defined CONFIG_IDF_TARGET_ESP32S2
+#define LCD_HOST SPI2_HOST
+#elif defined CONFIG_IDF_TARGET_ESP32S3
+#define LCD_HOST SPI2_HOST
+#elif defined CONFIG_IDF_TARGET_ESP32C3
+#define LCD_HOST SPI2_HOST
+#elif defined CONFIG_IDF_TARGET_ESP32P4
+#define LCD_HOST SPI2_HOST
+#endif
+#endif
+
+#if CONFIG_SPI2_HOST
+#define HOST_ID SPI2_HOST
+#elif CONFIG_SPI3_HOST
+#define HOST_ID SPI3_HOST
+#endif
+
+#define SPI_DEFAULT_FREQUENCY SPI_MASTER_FREQ_20M; // 20MHz
+
+static const int SPI_Command_Mode = 0;
+static const int SPI_Data_Mode = 1;
+//static const int SPI_Frequency = SPI_MASTER_FREQ_20M;
+//static const int SPI_Frequency = SPI_MASTER_FREQ_26M;
+//static const int SPI_Frequency = SPI_MASTER_FREQ_40M;
+//static const int SPI_Frequency = 60000000;
+//static const int SPI_Frequency = SPI_MASTER_FREQ_80M;
+
+// The DC pin and level travel in spi_transaction_t.user.
+// Bit 0 is the level, bits 1-7 are GPIO+1 so that NULL leaves DC untouched.
+// Bits 8-14 are the CS GPIO+1 when CS is driven by the callbacks instead of the SPI driver.
+#define SPI_DC_USER(cs, gpio, level) ((void *)(intptr_t)((((cs) + 1) << 8) | (((gpio) + 1) << 1) | (level)))
+
+#define SPI_MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define SPI_MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+// Largest DMA transaction of the SPI host (SPI_LL_DMA_MAX_BIT_LEN).
+// The ESP32 takes 2^24 bits, the later targets 2^18 bits.
+#ifdef CONFIG_IDF_TARGET_ESP32
+#define SPI_DMA_MAX_TRANSFER_SIZE ((1 << 24) / 8)
+#else
+#define SPI_DMA_MAX_TRANSFER_SIZE ((1 << 18) / 8)
+#endif
+
+// Largest transaction of the frame buffer flush.
+// Longer flushes are split into transactions of this size.
+#if CONFIG_FLUSH_TRANSFER_FRAME
+#define FLUSH_TRANSFER_SIZE SPI_MIN(CONFIG_WIDTH * CONFIG_HEIGHT * 2, SPI_DMA_MAX_TRANSFER_SIZE)
+#elif CONFIG_FLUSH_TRANSFER_LINES
+#define FLUSH_TRANSFER_SIZE SPI_MIN(CONFIG_WIDTH * CONFIG_FLUSH_TRANSFER_LINE_COUNT * 2, SPI_DMA_MAX_TRANSFER_SIZE)
+#else
+#define FLUSH_TRANSFER_SIZE CONFIG_BOUNCE_BUFFER_SIZE
+#endif
+
+// Size of each bounce buffer.
+// With N lines, pixels that are converted or copied on the way are sent N lines at a time as well.
+// A whole frame doesn't fit in DMA-capable RAM twice, so those keep BOUNCE_BUFFER_SIZE.
+#if CONFIG_FLUSH_TRANSFER_LINES
+#define BOUNCE_BUFFER_SIZE SPI_MIN(SPI_MAX(FLUSH_TRANSFER_SIZE, CONFIG_BOUNCE_BUFFER_SIZE), 32768)
+#else
+#define BOUNCE_BUFFER_SIZE CONFIG_BOUNCE_BUFFER_SIZE
+#endif
+
+// Copies through the bounce buffers are done in multiples of this,
+// so the source is read in whole cache lines of PSRAM
+#define BOUNCE_COPY_ALIGN 64
+
+// Largest transaction on the bus, the max_transfer_sz of spi_master_init_host.
+// Pixel data is still split at FLUSH_TRANSFER_SIZE.
+#define SPI_MAX_TRANSFER_SIZE SPI_MAX(SPI_MAX(FLUSH_TRANSFER_SIZE, BOUNCE_BUFFER_SIZE), CONFIG_FILL_BUFFER_SIZE)
+
+// Default clock of spi_master_init
+int clock_speed_hz = SPI_DEFAULT_FREQUENCY;
+
+// Default pixel clock of spi_master_init. 0 uses clock_speed_hz for everything.
+int pixel_clock_speed_hz = 0;
+
+// Called by the SPI driver just before a transaction starts
+static void IRAM_ATTR spi_pre_transfer_callback(spi_transaction_t *t)
+{
+	int user = (int)(intptr_t)t->user;
+	if (user == 0) return;
+	if (user >> 8) gpio_set_level( (user >> 8) - 1, 0 );
+	gpio_set_level( ((user >> 1) & 0x7F) - 1, user & 1 );
+}
+
+// Called by the SPI driver just after a transaction is done
+static void IRAM_ATTR spi_post_transfer_callback(spi_transaction_t *t)
+{
+	int user = (int)(intptr_t)t->user;
+	if (user >> 8) gpio_set_level( (user >> 8) - 1, 1 );
+}
+
+void spi_clock_speed(int speed) {
+	ESP_LOGI(TAG, "SPI clock speed=%d MHz", speed/1000000);
+	clock_speed_hz = speed;
+}
+
+void spi_pixel_clock_speed(int speed) {
+	ESP_LOGI(TAG, "SPI pixel clock speed=%d MHz", speed/1000000);
+	pixel_clock_speed_hz = speed;
+}
+
+static bool spi_master_ops_write_command(TFT_t * dev, uint8_t cmd);
+static bool spi_master_ops_write_data(TFT_t * dev, const uint8_t * Data, uint32_t DataLength);
+static bool spi_master_ops_write_pixels(TFT_t * dev, const uint16_t * colors, uint32_t size);
+static bool spi_master_ops_write_indexed(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size);
+static bool spi_master_ops_write_packed(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size);
+static bool spi_master_ops_write_color(TFT_t * dev, uint16_t color, uint32_t size);
+static void spi_master_ops_flush(TFT_t * dev);
+static void spi_master_ops_backlight(TFT_t * dev, int level);
+static void spi_master_select(TFT_t * dev, spi_device_handle_t handle);
+
+// ESP-IDF SPI master transport
+static const TFT_ops_t spi_master_ops = {
+	.write_command = spi_master_ops_write_command,
+	.write_data = spi_master_ops_write_data,
+	.write_pixels = spi_master_ops_write_pixels,
+	.write_indexed = spi_master_ops_write_indexed,
+	.write_packed = spi_master_ops_write_packed,
+	.write_color = spi_master_ops_write_color,
+	.flush = spi_master_ops_flush,
+	.backlight = spi_master_ops_backlight,
+};
+
+// Initialize the SPI bus and add the panel to it.
+// The bus is SPI2_HOST or SPI3_HOST from menuconfig, the clocks are set by spi_clock_speed and spi_pixel_clock_speed.
+void spi_master_init(TFT_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
+{
+	spi_master_init_host(dev, HOST_ID, clock_speed_hz, GPIO_MOSI, GPIO_SCLK, GPIO_CS, GPIO_DC, GPIO_RESET, GPIO_BL);
+	if (pixel_clock_speed_hz != 0) spi_master_set_pixel_clock(dev, pixel_clock_speed_hz);
+}
+
+// Initialize the SPI bus on host and add the panel to it.
+// When the bus is initialized already, the panel joins it.
+void spi_master_init_host(TFT_t * dev, spi_host_device_t host, int speed, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
+{
+	esp_err_t ret;
+
+	ESP_LOGI(TAG, "GPIO_MOSI=%d",GPIO_MOSI);
+	ESP_LOGI(TAG, "GPIO_SCLK=%d",GPIO_SCLK);
+	spi_bus_config_t buscfg = {
+		.mosi_io_num = GPIO_MOSI,
+		.miso_io_num = -1,
+		.sclk_io_num = GPIO_SCLK,
+		.quadwp_io_num = -1,
+		.quadhd_io_num = -1,
+		.max_transfer_sz = SPI_MAX_TRANSFER_SIZE,
+		.flags = 0
+	};
+
+	ESP_LOGI(TAG, "max_transfer_sz=%d",buscfg.max_transfer_sz);
+	ret = spi_bus_initialize( host, &buscfg, SPI_DMA_CH_AUTO );
+	ESP_LOGD(TAG, "spi_bus_initialize=%d",ret);
+	if (ret == ESP_ERR_INVALID_STATE) {
+		// Another driver, such as an SD card, has initialized the bus already
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+		ESP_LOGW(TAG, "SPI host %d is already initialized. Joining it", host);
+#else
+		ESP_LOGW(TAG, "SPI host %d is already initialized. Joining it, max_transfer_sz must be %d or more", host, SPI_MAX_TRANSFER_SIZE);
+#endif
+	} else {
+		assert(ret==ESP_OK);
+	}
+
+	spi_master_add_device(dev, host, speed, GPIO_CS, GPIO_DC, GPIO_RESET, GPIO_BL);
+}
+
+// Add one SPI device for the panel on CS
+static spi_device_handle_t spi_master_new_device(spi_host_device_t host, int speed, int16_t GPIO_CS)
+{
+	esp_err_t ret;
+
+	spi_device_interface_config_t devcfg;
+	memset(&devcfg, 0, sizeof(devcfg));
+	//devcfg.clock_speed_hz = SPI_Frequency;
+	devcfg.clock_speed_hz = speed;
+	devcfg.queue_size = SPI_QUEUE_SIZE;
+	devcfg.pre_cb = spi_pre_transfer_callback;
+	devcfg.post_cb = spi_post_transfer_callback;
+	//devcfg.mode = 2;
+	devcfg.mode = 3;
+	devcfg.flags = SPI_DEVICE_NO_DUMMY;
+
+	if ( GPIO_CS >= 0 ) {
+		devcfg.spics_io_num = GPIO_CS;
+	} else {
+		devcfg.spics_io_num = -1;
+	}
+	
+	spi_device_handle_t handle;
+	ret = spi_bus_add_device( host, &devcfg, &handle);
+	ESP_LOGD(TAG, "spi_bus_add_device=%d",ret);
+	assert(ret==ESP_OK);
+	return handle;
+}
+
+// Add the panel to an SPI bus that is already initialized.
+// Each panel needs its own CS and DC.
+// Transfers are split to fit the max_transfer_sz of the bus.
+// Before ESP-IDF V5.1 it can't be read, so it must be at least SPI_MAX_TRANSFER_SIZE.
+void spi_master_add_device(TFT_t * dev, spi_host_device_t host, int speed, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
+{
+	ESP_LOGI(TAG, "GPIO_CS=%d",GPIO_CS);
+	if ( GPIO_CS >= 0 ) {
+		//gpio_pad_select_gpio( GPIO_CS );
+		gpio_reset_pin( GPIO_CS );
+		gpio_set_direction( GPIO_CS, GPIO_MODE_OUTPUT );
+		gpio_set_level( GPIO_CS, 0 );
+	}
+
+	ESP_LOGI(TAG, "GPIO_DC=%d",GPIO_DC);
+	//gpio_pad_select_gpio( GPIO_DC );
+	gpio_reset_pin( GPIO_DC );
+	gpio_set_direction( GPIO_DC, GPIO_MODE_OUTPUT );
+	gpio_set_level( GPIO_DC, 0 );
+
+	ESP_LOGI(TAG, "GPIO_RESET=%d",GPIO_RESET);
+	if ( GPIO_RESET >= 0 ) {
+		//gpio_pad_select_gpio( GPIO_RESET );
+		gpio_reset_pin( GPIO_RESET );
+		gpio_set_direction( GPIO_RESET, GPIO_MODE_OUTPUT );
+		gpio_set_level( GPIO_RESET, 1 );
+		delayMS(100);
+		gpio_set_level( GPIO_RESET, 0 );
+		delayMS(100);
+		gpio_set_level( GPIO_RESET, 1 );
+		delayMS(100);
+	}
+
+	ESP_LOGI(TAG, "GPIO_BL=%d",GPIO_BL);
+	if ( GPIO_BL >= 0 ) {
+		//gpio_pad_select_gpio(GPIO_BL);
+		gpio_reset_pin(GPIO_BL);
+		gpio_set_direction( GPIO_BL, GPIO_MODE_OUTPUT );
+		gpio_set_level( GPIO_BL, 0 );
+	}
+
+	spi_device_handle_t handle = spi_master_new_device(host, speed, GPIO_CS);
+	dev->_dc = GPIO_DC;
+	dev->_bl = GPIO_BL;
+	dev->_cs = GPIO_CS;
+	dev->_cs_manual = -1;
+	dev->_SPIHandle = handle;
+	dev->_SPIControl = handle;
+	dev->_SPIPixel = handle;
+	dev->_host = host;
+	dev->_clock_speed_hz = speed;
+	dev->_pixel_clock_hz = speed;
+	dev->_ramwr = false;
+	dev->_trans_queued = 0;
+	dev->_trans_done = 0;
+	dev->_trans_head = 0;
+	dev->_burst = false;
+	dev->_max_transfer = SPI_MAX_TRANSFER_SIZE;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+	size_t bus_max;
+	if (spi_bus_get_max_transaction_len(host, &bus_max) == ESP_OK && bus_max < dev->_max_transfer) {
+		// Joined a bus initialized with a smaller max_transfer_sz
+		dev->_max_transfer = bus_max & ~3;
+		ESP_LOGW(TAG, "SPI host %d takes %"PRIu32" bytes per transaction", host, dev->_max_transfer);
+	}
+#endif
+
+	// DMA bounce buffers for pixel data
+	dev->_bounce_count = CONFIG_BOUNCE_BUFFER_COUNT;
+	dev->_bounce_index = 0;
+	dev->_bounce_size = SPI_MIN(BOUNCE_BUFFER_SIZE, dev->_max_transfer);
+	for (int i=0;i<dev->_bounce_count;i++) {
+		dev->_bounce[i] = heap_caps_malloc(dev->_bounce_size, MALLOC_CAP_DMA);
+		assert(dev->_bounce[i] != NULL);
+		dev->_bounce_seq[i] = 0;
+	}
+	ESP_LOGI(TAG, "bounce buffer=%d x %d bytes", dev->_bounce_count, dev->_bounce_size);
+
+	// DMA pattern buffer for solid fills
+	dev->_fill_size = SPI_MIN(CONFIG_FILL_BUFFER_SIZE, dev->_max_transfer);
+	dev->_fill = heap_caps_malloc(dev->_fill_size, MALLOC_CAP_DMA);
+	assert(dev->_fill != NULL);
+	dev->_fill_seq = 0;
+	dev->_fill_valid = false;
+
+	dev->_ops = &spi_master_ops;
+	dev->_bus = NULL;
+	lcdClearHandles(dev);
+}
+
+// Send pixel data at a higher clock than commands.
+// Commands, parameters and short pixel writes keep the clock of spi_master_init,
+// pixel data of CONFIG_SPI_PIXEL_CLOCK_THRESHOLD bytes or more is sent at speed.
+// This uses two SPI devices, which can not share a hardware CS, so while the clocks
+// differ both are added without CS and the callbacks drive CS around each transaction.
+// Call outside of lcdBeginBurst and lcdEndBurst.
+void spi_master_set_pixel_clock(TFT_t * dev, int speed)
+{
+	esp_err_t ret;
+	assert(dev->_burst == false);
+	spi_master_ops_flush(dev);
+	if (dev->_SPIPixel != dev->_SPIControl) {
+		ret = spi_bus_remove_device(dev->_SPIPixel);
+		assert(ret==ESP_OK);
+	}
+	ret = spi_bus_remove_device(dev->_SPIControl);
+	assert(ret==ESP_OK);
+
+	dev->_pixel_clock_hz = speed;
+	if (speed == dev->_clock_speed_hz) {
+		dev->_cs_manual = -1;
+		dev->_SPIControl = spi_master_new_device(dev->_host, dev->_clock_speed_hz, dev->_cs);
+		dev->_SPIPixel = dev->_SPIControl;
+	} else {
+		ESP_LOGI(TAG, "pixel clock=%d MHz", speed/1000000);
+		dev->_cs_manual = dev->_cs;
+		if (dev->_cs >= 0) {
+			gpio_reset_pin( dev->_cs );
+			gpio_set_direction( dev->_cs, GPIO_MODE_OUTPUT );
+			gpio_set_level( dev->_cs, 1 );
+		}
+		dev->_SPIControl = spi_master_new_device(dev->_host, dev->_clock_speed_hz, -1);
+		dev->_SPIPixel = spi_master_new_device(dev->_host, speed, -1);
+	}
+	dev->_SPIHandle = dev->_SPIControl;
+}
+
+// Blocking transfer.
+// Do not mix with queued transfers on the same device without calling spi_master_sync() first.
+bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength)
+{
+	spi_transaction_t SPITransaction;
+	esp_err_t ret;
+
+	if ( DataLength > 0 ) {
+		memset( &SPITransaction, 0, sizeof( spi_transaction_t ) );
+		SPITransaction.length = DataLength * 8;
+		SPITransaction.tx_buffer = Data;
+#if 1
+		ret = spi_device_transmit( SPIHandle, &SPITransaction );
+#else
+		ret = spi_device_polling_transmit( SPIHandle, &SPITransaction );
+#endif
+		assert(ret==ESP_OK); 
+	}
+
+	return true;
+}
+
+// Collect the oldest queued transaction
+static void spi_master_wait_one(TFT_t * dev)
+{
+	spi_transaction_t *rtrans;
+	esp_err_t ret;
+
+#if CONFIG_LCD_STATS
+	int64_t start = esp_timer_get_time();
+#endif
+	ret = spi_device_get_trans_result( dev->_SPIHandle, &rtrans, portMAX_DELAY );
+	assert(ret==ESP_OK);
+	LCD_STATS_ADD(dev, blocked_us, esp_timer_get_time() - start);
+	dev->_trans_done++;
+}
+
+// Wait until all queued transactions are finished
+static void spi_master_ops_flush(TFT_t * dev)
+{
+	while (dev->_trans_done != dev->_trans_queued) {
+		spi_master_wait_one(dev);
+	}
+}
+
+// Switch the device that the next transfers use.
+// Transactions of two devices are not ordered, so the old one is drained first.
+// In burst mode the bus is handed over to the new device.
+static void spi_master_select(TFT_t * dev, spi_device_handle_t handle)
+{
+	if (dev->_SPIHandle == handle) return;
+	spi_master_ops_flush(dev);
+	if (dev->_burst) {
+		spi_device_release_bus( dev->_SPIHandle );
+		esp_err_t ret = spi_device_acquire_bus( handle, portMAX_DELAY );
+		assert(ret==ESP_OK);
+	}
+	dev->_SPIHandle = handle;
+}
+
+// Queue a transfer without waiting for it.
+// Up to 4 bytes are copied into the transaction, so Data can be reused at once.
+// Longer buffers must stay untouched until spi_master_sync() returns.
+// In burst mode, transfers shorter than CONFIG_SPI_POLLING_THRESHOLD are sent by polling instead.
+// dc:SPI_Command_Mode or SPI_Data_Mode. It is set by spi_pre_transfer_callback.
+bool spi_master_queue_byte(TFT_t * dev, const uint8_t* Data, size_t DataLength, int dc)
+{
+	spi_transaction_t *SPITransaction;
+	esp_err_t ret;
+
+	if ( DataLength > 0 && dev->_SPIPixel != dev->_SPIControl ) {
+		// Pixel data goes at the pixel clock, everything else at the control clock.
+		// Short pixel writes don't switch to avoid draining the queue for a few bytes.
+		if ( dc == SPI_Data_Mode && dev->_ramwr ) {
+			if ( DataLength >= CONFIG_SPI_PIXEL_CLOCK_THRESHOLD ) spi_master_select(dev, dev->_SPIPixel);
+		} else {
+			spi_master_select(dev, dev->_SPIControl);
+		}
+	}
+
+	if ( DataLength > 0 && dev->_burst && DataLength < CONFIG_SPI_POLLING_THRESHOLD ) {
+		// Polling can't start while interrupt transactions are pending
+		spi_master_ops_flush(dev);
+		spi_transaction_t PollTransaction;
+		memset( &PollTransaction, 0, sizeof( spi_transaction_t ) );
+		PollTransaction.length = DataLength * 8;
+		if ( DataLength <= 4 ) {
+			PollTransaction.flags = SPI_TRANS_USE_TXDATA;
+			memcpy( PollTransaction.tx_data, Data, DataLength );
+		} else {
+			PollTransaction.tx_buffer = Data;
+		}
+		PollTransaction.user = SPI_DC_USER(dev->_cs_manual, dev->_dc, dc);
+#if CONFIG_LCD_STATS
+		int64_t start = esp_timer_get_time();
+#endif
+		ret = spi_device_polling_transmit( dev->_SPIHandle, &PollTransaction );
+		assert(ret==ESP_OK);
+		LCD_STATS_ADD(dev, blocked_us, esp_timer_get_time() - start);
+		if (dc == SPI_Data_Mode) LCD_STATS_ADD(dev, transactions, 1);
+	} else if ( DataLength > 0 ) {
+		// Transactions complete in order, so the slot at the head is free
+		// once fewer than SPI_QUEUE_SIZE transactions are pending.
+		if (dev->_trans_queued - dev->_trans_done == SPI_QUEUE_SIZE) spi_master_wait_one(dev);
+		// The counters wrap at 2^32, which isn't a multiple of SPI_QUEUE_SIZE, so the slot has its own index.
+		SPITransaction = &dev->_trans[dev->_trans_head];
+
+		memset( SPITransaction, 0, sizeof( spi_transaction_t ) );
+		SPITransaction->length = DataLength * 8;
+		if ( DataLength <= 4 ) {
+			SPITransaction->flags = SPI_TRANS_USE_TXDATA;
+			memcpy( SPITransaction->tx_data, Data, DataLength );
+		} else {
+			SPITransaction->tx_buffer = Data;
+		}
+		SPITransaction->user = SPI_DC_USER(dev->_cs_manual, dev->_dc, dc);
+		ret = spi_device_queue_trans( dev->_SPIHandle, SPITransaction, portMAX_DELAY );
+		assert(ret==ESP_OK);
+		dev->_trans_queued++;
+		dev->_trans_head = (dev->_trans_head + 1) % SPI_QUEUE_SIZE;
+		if (dc == SPI_Data_Mode) LCD_STATS_ADD(dev, transactions, 1);
+	}
+
+	return true;
+}
+
+static bool spi_master_write_bounce(TFT_t * dev, const uint8_t * Data, uint32_t DataLength);
+
+// Queue any number of data bytes.
+// Up to 4 bytes are copied, longer DMA-capable data is sent without copying.
+// Then it must stay untouched until spi_master_sync() returns.
+// Data the DMA can't read, such as a frame buffer in PSRAM, is copied through the bounce buffers.
+// Each transaction carries up to FLUSH_TRANSFER_SIZE bytes, as far as the bus allows.
+static bool spi_master_ops_write_data(TFT_t * dev, const uint8_t * Data, uint32_t DataLength)
+{
+	if (DataLength > 4 && !esp_ptr_dma_capable(Data)) return spi_master_write_bounce(dev, Data, DataLength);
+	uint32_t max_transfer = SPI_MIN(dev->_max_transfer, FLUSH_TRANSFER_SIZE);
+	while (DataLength > 0) {
+		uint32_t bs = (DataLength > max_transfer) ? max_transfer : DataLength;
+		spi_master_queue_byte( dev, Data, bs, SPI_Data_Mode );
+		DataLength -= bs;
+		Data += bs;
+	}
+	return true;
+}
+
+// Start a burst.
+// The SPI bus is held until lcdEndBurst, and short transfers are sent by polling.
+// This saves the interrupt and queue overhead of short command sequences.
+// A flush of lcdDrawFinishAsync in flight is waited for first, it sends on the same device.
+void lcdBeginBurst(TFT_t * dev)
+{
+	if (dev->_ops != &spi_master_ops) return;
+	if (dev->_burst) return;
+	lcdWaitFlush(dev);
+	spi_master_ops_flush(dev);
+	esp_err_t ret = spi_device_acquire_bus( dev->_SPIHandle, portMAX_DELAY );
+	assert(ret==ESP_OK);
+	dev->_burst = true;
+}
+
+// End a burst and release the SPI bus
+void lcdEndBurst(TFT_t * dev)
+{
+	if (dev->_ops != &spi_master_ops) return;
+	if (dev->_burst == false) return;
+	spi_master_ops_flush(dev);
+	spi_device_release_bus( dev->_SPIHandle );
+	dev->_burst = false;
+}
+
+static bool spi_master_ops_write_command(TFT_t * dev, uint8_t cmd)
+{
+	dev->_ramwr = (cmd == 0x2C || cmd == 0x3C);
+	return spi_master_queue_byte( dev, &cmd, 1, SPI_Command_Mode );
+}
+
+// Take the next DMA bounce buffer.
+// Waits until the transfer that last used it is finished.
+static uint8_t * spi_master_next_bounce(TFT_t * dev)
+{
+	uint8_t index = dev->_bounce_index;
+	dev->_bounce_index = (index + 1) % dev->_bounce_count;
+	while ((int32_t)(dev->_trans_done - dev->_bounce_seq[index]) < 0) {
+		spi_master_wait_one(dev);
+	}
+	return dev->_bounce[index];
+}
+
+// Queue a filled bounce buffer and remember which transaction reads it
+static bool spi_master_queue_bounce(TFT_t * dev, uint8_t * Byte, size_t DataLength)
+{
+	bool ret = spi_master_queue_byte( dev, Byte, DataLength, SPI_Data_Mode );
+	for (int i=0;i<dev->_bounce_count;i++) {
+		if (dev->_bounce[i] == Byte) dev->_bounce_seq[i] = dev->_trans_queued;
+	}
+	return ret;
+}
+
+// Send data the DMA can't read through the DMA bounce buffers.
+// While the DMA sends one buffer, the CPU copies the next chunk into another one.
+// After the first chunk, every chunk starts on a cache line of the source and is a whole number of lines long.
+// The SPI driver would otherwise allocate a DMA buffer of the full length for every transaction.
+static bool spi_master_write_bounce(TFT_t * dev, const uint8_t * Data, uint32_t DataLength)
+{
+	uint32_t chunk = dev->_bounce_size & ~(BOUNCE_COPY_ALIGN - 1);
+	uint32_t bs = chunk - ((uintptr_t)Data & (BOUNCE_COPY_ALIGN - 1));
+	while (DataLength > 0) {
+		if (bs > DataLength) bs = DataLength;
+		uint8_t *Byte = spi_master_next_bounce(dev);
+		memcpy(Byte, Data, bs);
+		spi_master_queue_bounce(dev, Byte, bs);
+		DataLength -= bs;
+		Data += bs;
+		bs = chunk;
+	}
+	return true;
+}
+
+// Fill with one color.
+// The pattern buffer holds the color and is sent as often as needed without refilling.
+// It is refilled only when the color changes, after the transfers reading it are finished.
+static bool spi_master_ops_write_color(TFT_t * dev, uint16_t color, uint32_t size)
+{
+	if (dev->_fill_valid == false || dev->_fill_color != color) {
+		while ((int32_t)(dev->_trans_done - dev->_fill_seq) < 0) {
+			spi_master_wait_one(dev);
+		}
+		int index = 0;
+		for (int i=0;i<dev->_fill_size/2;i++) {
+			dev->_fill[index++] = (color >> 8) & 0xFF;
+			dev->_fill[index++] = color & 0xFF;
+		}
+		dev->_fill_color = color;
+		dev->_fill_valid = true;
+	}
+
+	uint32_t chunk = dev->_fill_size / 2;
+	while (size > 0) {
+		uint32_t bs = (size > chunk) ? chunk : size;
+		spi_master_queue_byte( dev, dev->_fill, bs*2, SPI_Data_Mode );
+		dev->_fill_seq = dev->_trans_queued;
+		size -= bs;
+	}
+	return true;
+}
+
+// Send any number of pixels through the DMA bounce buffers.
+// While the DMA sends one buffer, the CPU byte-swaps the next chunk into another one.
+static bool spi_master_ops_write_pixels(TFT_t * dev, const uint16_t * colors, uint32_t size)
+{
+	uint32_t chunk = dev->_bounce_size / 2;
+	while (size > 0) {
+		uint32_t bs = (size > chunk) ? chunk : size;
+		uint8_t *Byte = spi_master_next_bounce(dev);
+		int index = 0;
+		for(int i=0;i<bs;i++) {
+			Byte[index++] = (colors[i] >> 8) & 0xFF;
+			Byte[index++] = colors[i] & 0xFF;
+		}
+		spi_master_queue_bounce(dev, Byte, bs*2);
+		size -= bs;
+		colors += bs;
+	}
+	return true;
+}
+
+// Send palette indices through the DMA bounce buffers.
+// Each index is expanded to its color in the panel byte order while the chunk before is sent.
+static bool spi_master_ops_write_indexed(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size)
+{
+	uint32_t chunk = dev->_bounce_size / 2;
+	while (size > 0) {
+		uint32_t bs = (size > chunk) ? chunk : size;
+		uint8_t *Byte = spi_master_next_bounce(dev);
+		int pos = 0;
+		for(int i=0;i<bs;i++) {
+			uint16_t color = palette[index[i]];
+			Byte[pos++] = (color >> 8) & 0xFF;
+			Byte[pos++] = color & 0xFF;
+		}
+		spi_master_queue_bounce(dev, Byte, bs*2);
+		size -= bs;
+		index += bs;
+	}
+	return true;
+}
+
+// Send packed pixels through the DMA bounce buffers.
+// Each chunk is expanded with the lookup table while the chunk before is sent.
+// Chunks hold whole bytes of data, so only the last one may end inside a byte.
+static bool spi_master_ops_write_packed(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size)
+{
+	uint32_t chunk = (dev->_bounce_size / 2) & ~7;
+	uint32_t pos = 0;
+	while (pos < size) {
+		uint32_t bs = (size - pos > chunk) ? chunk : size - pos;
+		uint8_t *Byte = spi_master_next_bounce(dev);
+		lcdUnpackPixels(data, bpp, lut, pos, bs, Byte);
+		spi_master_queue_bounce(dev, Byte, bs*2);
+		pos += bs;
+	}
+	return true;
+}
+
+static void spi_master_ops_backlight(TFT_t * dev, int level)
+{
+	if(dev->_bl >= 0) {
+		gpio_set_level( dev->_bl, level );
+	}
+}
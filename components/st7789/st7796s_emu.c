@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "st7796s_emu.h"
+
+// MADCTL bits
+#define EMU_MY 0x80
+#define EMU_MX 0x40
+#define EMU_MV 0x20
+
+static bool emu_write_command(TFT_t * dev, uint8_t cmd);
+static bool emu_write_data(TFT_t * dev, const uint8_t * data, uint32_t length);
+static bool emu_write_pixels(TFT_t * dev, const uint16_t * colors, uint32_t size);
+static bool emu_write_indexed(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size);
+static bool emu_write_packed(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size);
+static bool emu_write_color(TFT_t * dev, uint16_t color, uint32_t size);
+static void emu_flush(TFT_t * dev);
+static void emu_backlight(TFT_t * dev, int level);
+
+static const TFT_ops_t emu_ops = {
+	.write_command = emu_write_command,
+	.write_data = emu_write_data,
+	.write_pixels = emu_write_pixels,
+	.write_indexed = emu_write_indexed,
+	.write_packed = emu_write_packed,
+	.write_color = emu_write_color,
+	.flush = emu_flush,
+	.backlight = emu_backlight,
+};
+
+// Connect dev to a new emulated panel
+// width:GRAM width
+// height:GRAM height
+void emuInit(TFT_t * dev, EMU_t * emu, int width, int height)
+{
+	memset(emu, 0, sizeof(EMU_t));
+	emu->_width = width;
+	emu->_height = height;
+	emu->_gram = calloc(width * height, sizeof(uint16_t));
+	emu->_xe = width - 1;
+	emu->_ye = height - 1;
+	emu->_vsa = height;
+
+	dev->_ops = &emu_ops;
+	dev->_bus = emu;
+	dev->_dc = -1;
+	dev->_bl = -1;
+	lcdClearHandles(dev);
+}
+
+void emuFree(EMU_t * emu)
+{
+	free(emu->_gram);
+	emu->_gram = NULL;
+}
+
+// Count transactions as the SPI backend would split them.
+// 0 counts every write as one transaction.
+void emuSetMaxTransfer(EMU_t * emu, uint32_t max_transfer)
+{
+	emu->_max_transfer = max_transfer;
+}
+
+void emuResetStats(EMU_t * emu)
+{
+	memset(&emu->stats, 0, sizeof(EMU_stats_t));
+}
+
+// Read GRAM in the physical order
+uint16_t emuGetPixel(EMU_t * emu, uint16_t x, uint16_t y)
+{
+	if (x >= emu->_width || y >= emu->_height) return 0;
+	return emu->_gram[y*emu->_width+x];
+}
+
+// Read what the panel shows at a physical position.
+// The vertical scrolling area is shifted by VSCRSADD.
+uint16_t emuGetVisiblePixel(EMU_t * emu, uint16_t x, uint16_t y)
+{
+	if (emu->_display_on == false) return 0;
+	if (y >= emu->_tfa && y < emu->_tfa + emu->_vsa) {
+		y = emu->_tfa + (y - emu->_tfa + emu->_vsp - emu->_tfa + emu->_vsa) % emu->_vsa;
+	}
+	return emuGetPixel(emu, x, y);
+}
+
+static void emu_count(EMU_t * emu, uint32_t length)
+{
+	emu->stats.bytes += length;
+	if (emu->_max_transfer == 0) {
+		emu->stats.transactions++;
+	} else {
+		emu->stats.transactions += (length + emu->_max_transfer - 1) / emu->_max_transfer;
+	}
+}
+
+// Count data and report the transactions to lcdGetStats as well
+static void emu_count_data(TFT_t * dev, uint32_t length)
+{
+	EMU_t *emu = dev->_bus;
+#if CONFIG_LCD_STATS
+	uint32_t transactions = emu->stats.transactions;
+	emu_count(emu, length);
+	LCD_STATS_ADD(dev, transactions, emu->stats.transactions - transactions);
+#else
+	emu_count(emu, length);
+#endif
+}
+
+// Store one pixel at the GRAM pointer and advance it
+static void emu_put_pixel(EMU_t * emu, uint16_t color)
+{
+	emu->stats.pixels++;
+	if (emu->_y > emu->_ye) return;
+
+	// Map the logical address through MADCTL
+	uint16_t col = emu->_x;
+	uint16_t row = emu->_y;
+	uint16_t cols = (emu->_madctl & EMU_MV) ? emu->_height : emu->_width;
+	uint16_t rows = (emu->_madctl & EMU_MV) ? emu->_width : emu->_height;
+	if (col < cols && row < rows) {
+		if (emu->_madctl & EMU_MX) col = cols - 1 - col;
+		if (emu->_madctl & EMU_MY) row = rows - 1 - row;
+		if (emu->_madctl & EMU_MV) {
+			emu->_gram[col*emu->_width+row] = color;
+		} else {
+			emu->_gram[row*emu->_width+col] = color;
+		}
+	}
+
+	if (++emu->_x > emu->_xe) {
+		emu->_x = emu->_xs;
+		emu->_y++;
+	}
+}
+
+static bool emu_write_command(TFT_t * dev, uint8_t cmd)
+{
+	EMU_t *emu = dev->_bus;
+	emu->stats.commands++;
+	emu_count(emu, 1);
+	emu->_cmd = cmd;
+	emu->_nparam = 0;
+	emu->_half = false;
+
+	switch (cmd) {
+	case 0x01: // Software Reset
+		emu->_madctl = 0;
+		emu->_tfa = 0;
+		emu->_vsa = emu->_height;
+		emu->_bfa = 0;
+		emu->_vsp = 0;
+		emu->_display_on = false;
+		emu->_inversion_on = false;
+		break;
+	case 0x20: // Display Inversion Off
+		emu->_inversion_on = false;
+		break;
+	case 0x21: // Display Inversion On
+		emu->_inversion_on = true;
+		break;
+	case 0x28: // Display OFF
+		emu->_display_on = false;
+		break;
+	case 0x29: // Display ON
+		emu->_display_on = true;
+		break;
+	case 0x2C: // Memory Write
+		emu->_x = emu->_xs;
+		emu->_y = emu->_ys;
+		break;
+	}
+	return true;
+}
+
+static void emu_write_param(EMU_t * emu, uint8_t data)
+{
+	if (emu->_nparam >= sizeof(emu->_param)) return;
+	emu->_param[emu->_nparam++] = data;
+	uint8_t *p = emu->_param;
+
+	switch (emu->_cmd) {
+	case 0x2A: // Column Address Set
+		if (emu->_nparam == 4) {
+			emu->_xs = (p[0] << 8) | p[1];
+			emu->_xe = (p[2] << 8) | p[3];
+		}
+		break;
+	case 0x2B: // Row Address Set
+		if (emu->_nparam == 4) {
+			emu->_ys = (p[0] << 8) | p[1];
+			emu->_ye = (p[2] << 8) | p[3];
+		}
+		break;
+	case 0x33: // Vertical Scrolling Definition
+		if (emu->_nparam == 6) {
+			emu->_tfa = (p[0] << 8) | p[1];
+			emu->_vsa = (p[2] << 8) | p[3];
+			emu->_bfa = (p[4] << 8) | p[5];
+		}
+		break;
+	case 0x36: // Memory Data Access Control
+		emu->_madctl = p[0];
+		break;
+	case 0x37: // Vertical Scrolling Start Address
+		if (emu->_nparam == 2) emu->_vsp = (p[0] << 8) | p[1];
+		break;
+	}
+}
+
+static bool emu_write_data(TFT_t * dev, const uint8_t * data, uint32_t length)
+{
+	EMU_t *emu = dev->_bus;
+	emu_count_data(dev, length);
+
+	bool ramwr = (emu->_cmd == 0x2C || emu->_cmd == 0x3C);
+	for (uint32_t i=0;i<length;i++) {
+		if (ramwr == false) {
+			emu_write_param(emu, data[i]);
+		} else if (emu->_half == false) {
+			emu->_high = data[i];
+			emu->_half = true;
+		} else {
+			emu_put_pixel(emu, (emu->_high << 8) | data[i]);
+			emu->_half = false;
+		}
+	}
+	return true;
+}
+
+static bool emu_write_pixels(TFT_t * dev, const uint16_t * colors, uint32_t size)
+{
+	EMU_t *emu = dev->_bus;
+	emu_count_data(dev, size*2);
+	if (emu->_cmd != 0x2C && emu->_cmd != 0x3C) return true;
+	for (uint32_t i=0;i<size;i++) {
+		emu_put_pixel(emu, colors[i]);
+	}
+	return true;
+}
+
+static bool emu_write_indexed(TFT_t * dev, const uint8_t * index, const uint16_t * palette, uint32_t size)
+{
+	EMU_t *emu = dev->_bus;
+	emu_count_data(dev, size*2);
+	if (emu->_cmd != 0x2C && emu->_cmd != 0x3C) return true;
+	for (uint32_t i=0;i<size;i++) {
+		emu_put_pixel(emu, palette[index[i]]);
+	}
+	return true;
+}
+
+static bool emu_write_packed(TFT_t * dev, const uint8_t * data, uint8_t bpp, const uint8_t * lut, uint32_t size)
+{
+	EMU_t *emu = dev->_bus;
+	emu_count_data(dev, size*2);
+	if (emu->_cmd != 0x2C && emu->_cmd != 0x3C) return true;
+	uint8_t bytes[2];
+	for (uint32_t i=0;i<size;i++) {
+		lcdUnpackPixels(data, bpp, lut, i, 1, bytes);
+		emu_put_pixel(emu, (bytes[0] << 8) | bytes[1]);
+	}
+	return true;
+}
+
+static bool emu_write_color(TFT_t * dev, uint16_t color, uint32_t size)
+{
+	EMU_t *emu = dev->_bus;
+	emu_count_data(dev, size*2);
+	if (emu->_cmd != 0x2C && emu->_cmd != 0x3C) return true;
+	for (uint32_t i=0;i<size;i++) {
+		emu_put_pixel(emu, color);
+	}
+	return true;
+}
+
+// Everything is applied at once
+static void emu_flush(TFT_t * dev)
+{
+}
+
+static void emu_backlight(TFT_t * dev, int level)
+{
+	EMU_t *emu = dev->_bus;
+	emu->_backlight = level;
+}
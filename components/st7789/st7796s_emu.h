@@ -0,0 +1,50 @@
+#ifndef MAIN_ST7796S_EMU_H_
+#define MAIN_ST7796S_EMU_H_
+
+#include "st7789.h"
+
+// In-memory ST7796S panel.
+// It decodes the command stream of a TFT_t and keeps the GRAM as host order RGB565,
+// so drawing code can be checked pixel by pixel without hardware.
+
+typedef struct {
+	uint32_t commands;
+	uint32_t transactions;
+	uint32_t bytes;
+	uint32_t pixels;
+} EMU_stats_t;
+
+typedef struct {
+	uint16_t _width;
+	uint16_t _height;
+	uint16_t *_gram;
+	uint32_t _max_transfer;
+	uint8_t _cmd;
+	uint8_t _nparam;
+	uint8_t _param[6];
+	bool _half;
+	uint8_t _high;
+	uint16_t _xs;
+	uint16_t _xe;
+	uint16_t _ys;
+	uint16_t _ye;
+	uint16_t _x;
+	uint16_t _y;
+	uint8_t _madctl;
+	uint16_t _tfa;
+	uint16_t _vsa;
+	uint16_t _bfa;
+	uint16_t _vsp;
+	bool _display_on;
+	bool _inversion_on;
+	bool _backlight;
+	EMU_stats_t stats;
+} EMU_t;
+
+void emuInit(TFT_t * dev, EMU_t * emu, int width, int height);
+void emuFree(EMU_t * emu);
+void emuSetMaxTransfer(EMU_t * emu, uint32_t max_transfer);
+uint16_t emuGetPixel(EMU_t * emu, uint16_t x, uint16_t y);
+uint16_t emuGetVisiblePixel(EMU_t * emu, uint16_t x, uint16_t y);
+void emuResetStats(EMU_t * emu);
+#endif /* MAIN_ST7796S_EMU_H_ */
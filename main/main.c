@@ -10,6 +10,7 @@
 #include "esp_system.h"
 #include "esp_vfs.h"
 #include "esp_spiffs.h"
+#include "esp_timer.h"
 
 #include "st7789.h"
 #include "fontx.h"
@@ -372,6 +373,7 @@ TickType_t RectAngleTest(TFT_t * dev, int width, int height) {
 	int angle;
 	for(angle=0;angle<=(360*3);angle=angle+30) {
 		lcdDrawRectAngle(dev, xpos, ypos, w, h, angle, color);
+		lcdDrawFinish(dev);
 		usleep(10000);
 		lcdDrawRectAngle(dev, xpos, ypos, w, h, angle, BLACK);
 	}
@@ -379,6 +381,7 @@ TickType_t RectAngleTest(TFT_t * dev, int width, int height) {
 	for(angle=0;angle<=180;angle=angle+30) {
 		lcdDrawRectAngle(dev, xpos, ypos, w, h, angle, color);
 	}
+	lcdDrawFinish(dev);
 
 	endTick = xTaskGetTickCount();
 	diffTick = endTick - startTick;
@@ -403,6 +406,7 @@ TickType_t TriangleTest(TFT_t * dev, int width, int height) {
 
 	for(angle=0;angle<=(360*3);angle=angle+30) {
 		lcdDrawTriangle(dev, xpos, ypos, w, h, angle, color);
+		lcdDrawFinish(dev);
 		usleep(10000);
 		lcdDrawTriangle(dev, xpos, ypos, w, h, angle, BLACK);
 	}
@@ -410,6 +414,7 @@ TickType_t TriangleTest(TFT_t * dev, int width, int height) {
 	for(angle=0;angle<=360;angle=angle+30) {
 		lcdDrawTriangle(dev, xpos, ypos, w, h, angle, color);
 	}
+	lcdDrawFinish(dev);
 
 	endTick = xTaskGetTickCount();
 	diffTick = endTick - startTick;
@@ -883,15 +888,17 @@ TickType_t JPEGTest(TFT_t * dev, char * file, int width, int height) {
 		}
 #endif
 
+		lcdBeginWindow(dev, _cols, _rows, _cols+_width-1, _rows+_height-1);
 		for(int y = 0; y < _height; y++){
 			for(int x = 0;x < _width; x++){
 				//pixel_jpeg pixel = pixels[y][x];
 				//colors[x] = rgb565(pixel.red, pixel.green, pixel.blue);
 				colors[x] = pixels[y][x];
 			}
-			lcdDrawMultiPixels(dev, _cols, y+_rows, _width, colors);
+			lcdPushPixels(dev, colors, _width);
 			vTaskDelay(1);
 		}
+		lcdEndWindow(dev);
 
 		lcdDrawFinish(dev);
 		free(colors);
@@ -992,15 +999,17 @@ TickType_t PNGTest(TFT_t * dev, char * file, int width, int height) {
 	}
 #endif
 
+	lcdBeginWindow(dev, _cols, _rows, _cols+_width-1, _rows+_height-1);
 	for(int y = 0; y < _height; y++){
 		for(int x = 0;x < _width; x++){
 			//pixel_png pixel = pngle->pixels[y][x];
 			//colors[x] = rgb565(pixel.red, pixel.green, pixel.blue);
 			colors[x] = pngle->pixels[y][x];
 		}
-		lcdDrawMultiPixels(dev, _cols, y+_rows, _width, colors);
+		lcdPushPixels(dev, colors, _width);
 		vTaskDelay(1);
 	}
+	lcdEndWindow(dev);
 	lcdDrawFinish(dev);
 	free(colors);
 	pngle_destroy(pngle, width, height);
@@ -1114,6 +1123,401 @@ TickType_t WrapArroundTest(TFT_t * dev, int width, int height) {
 	return diffTick;
 }
 
+// Full screen scroll steps, which only move the row origin of the frame buffer
+TickType_t OriginScrollTest(TFT_t * dev, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	int steps = 10;
+	int64_t start = esp_timer_get_time();
+	for (int i=0;i<steps;i++) {
+		lcdWrapArround(dev, SCROLL_UP, 0, width-1);
+		lcdDrawFinish(dev);
+	}
+	lcdWaitFlush(dev);
+	ESP_LOGI(__FUNCTION__, "full screen step[us]:%"PRId64, (esp_timer_get_time() - start)/steps);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+
+// Terminal-style hardware scrolling. Each new line costs one command and the pixels of the line.
+TickType_t ScrollTest(TFT_t * dev, FontxFile *fx, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	uint8_t buffer[FontxGlyphBufSize];
+	uint8_t fontWidth;
+	uint8_t fontHeight;
+	GetFontx(fx, 0, buffer, &fontWidth, &fontHeight);
+
+	// A fixed title on top, and a scroll area of whole lines
+	uint16_t top = fontHeight;
+	uint16_t bottom = (height - top) % fontHeight;
+	lcdFillScreen(dev, BLACK);
+	lcdSetFontFill(dev, BLUE);
+	lcdDrawString(dev, fx, 0, fontHeight-1, (uint8_t *)"Hardware scroll", WHITE);
+	lcdUnsetFontFill(dev);
+	lcdDrawFinish(dev);
+	lcdSetScrollArea(dev, top, bottom);
+
+	uint8_t ascii[24];
+	int lines = (height - top - bottom) / fontHeight * 3;
+	int64_t start = esp_timer_get_time();
+	for(int i=0;i<lines;i++) {
+		uint16_t ypos = lcdScroll(dev, fontHeight, BLACK);
+		sprintf((char *)ascii, "line %d", i);
+		lcdDrawString(dev, fx, 0, ypos+fontHeight-1, ascii, (i%2) ? GREEN : YELLOW);
+		lcdDrawFinish(dev);
+	}
+	lcdWaitFlush(dev);
+	ESP_LOGI(__FUNCTION__, "line[us]:%"PRId64, (esp_timer_get_time() - start)/lines);
+	lcdSetScrollArea(dev, 0, 0);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+
+// Latency of short primitives with and without burst mode
+TickType_t BurstTest(TFT_t * dev, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	lcdFillScreen(dev, BLACK);
+	uint16_t colors[32];
+	for(int i=0;i<32;i++) {
+		uint8_t red = i*8;
+		uint8_t green = 255-red;
+		colors[i] = rgb565(red, green, 128);
+	}
+
+	int64_t latency[2][3];
+	for(int burst=0;burst<2;burst++) {
+		if (burst) lcdBeginBurst(dev);
+		int64_t start = esp_timer_get_time();
+		for(int i=0;i<1000;i++) {
+			lcdDrawPixel(dev, (i*7)%width, (i*13)%height, WHITE);
+		}
+		spi_master_sync(dev);
+		latency[burst][0] = esp_timer_get_time() - start;
+
+		start = esp_timer_get_time();
+		for(int i=0;i<1000;i++) {
+			lcdDrawMultiPixels(dev, (i*7)%(width-32), (i*13)%height, 32, colors);
+		}
+		spi_master_sync(dev);
+		latency[burst][1] = esp_timer_get_time() - start;
+
+		start = esp_timer_get_time();
+		for(int i=0;i<1000;i++) {
+			uint16_t xpos = (i*7)%(width-8);
+			uint16_t ypos = (i*13)%(height-8);
+			lcdDrawFillRect(dev, xpos, ypos, xpos+7, ypos+7, CYAN);
+		}
+		spi_master_sync(dev);
+		latency[burst][2] = esp_timer_get_time() - start;
+		if (burst) lcdEndBurst(dev);
+	}
+	// 1000 calls, so the elapsed time in ms is the latency of one call in us
+	ESP_LOGI(__FUNCTION__, "lcdDrawPixel[us]:%"PRId64"->%"PRId64, latency[0][0]/1000, latency[1][0]/1000);
+	ESP_LOGI(__FUNCTION__, "lcdDrawMultiPixels(32)[us]:%"PRId64"->%"PRId64, latency[0][1]/1000, latency[1][1]/1000);
+	ESP_LOGI(__FUNCTION__, "lcdDrawFillRect(8x8)[us]:%"PRId64"->%"PRId64, latency[0][2]/1000, latency[1][2]/1000);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+
+TickType_t FlushTest(TFT_t * dev, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	// Send 10 full frames.
+	// With the frame buffer or band rendering only lcdDrawFinish is measured, otherwise lcdFillScreen.
+	bool deferred = dev->_use_frame_buffer || dev->_band;
+	uint16_t color[2] = {RED, BLUE};
+	int64_t elapsed = 0;
+	for(int i=0;i<10;i++) {
+		if (deferred) lcdFillScreen(dev, color[i%2]);
+		int64_t start = esp_timer_get_time();
+		if (deferred) {
+			lcdDrawFinish(dev);
+		} else {
+			lcdFillScreen(dev, color[i%2]);
+		}
+		spi_master_sync(dev);
+		elapsed += esp_timer_get_time() - start;
+	}
+
+	// Bytes per microsecond is MB/s
+	float bytes = 10.0 * width * height * 2;
+	float achieved = bytes / elapsed;
+	float theoretical = dev->_pixel_clock_hz / 8.0 / 1000000.0;
+	ESP_LOGI(__FUNCTION__, "frame[us]:%"PRId64, elapsed/10);
+	ESP_LOGI(__FUNCTION__, "achieved[MB/s]:%.2f theoretical[MB/s]:%.2f (%.0f%%)", achieved, theoretical, achieved*100.0/theoretical);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+
+// Measure FlushTest with the frame buffer in internal RAM and in PSRAM
+TickType_t PlacementTest(TFT_t * dev, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	int placement[2] = {LCD_FB_INTERNAL, LCD_FB_PSRAM};
+	char *name[2] = {"internal", "PSRAM"};
+	int initial = dev->_fb_placement;
+	for(int i=0;i<2;i++) {
+		if (lcdPlaceFrameBuffer(dev, placement[i]) == false) {
+			ESP_LOGW(__FUNCTION__, "frame buffer doesn't fit in %s", name[i]);
+			continue;
+		}
+		ESP_LOGI(__FUNCTION__, "frame buffer in %s", name[i]);
+		FlushTest(dev, width, height);
+	}
+	lcdPlaceFrameBuffer(dev, initial);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+
+#if CONFIG_LCD_STATS
+// Show where the time of a workload goes
+void ShowStats(TFT_t * dev, char * name, int64_t elapsed) {
+	lcd_stats_t stats;
+	lcdGetStats(dev, &stats);
+	ESP_LOGI(__FUNCTION__, "%s elapsed[us]:%"PRId64" blocked[us]:%"PRId64" commands:%"PRIu32" transactions:%"PRIu32" pixel bytes:%"PRIu32" windows:%"PRIu32,
+		name, elapsed, stats.blocked_us, stats.commands, stats.transactions, stats.pixel_bytes, stats.window_sets);
+}
+
+TickType_t StatsTest(TFT_t * dev, FontxFile *fx, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	// Bandwidth bound
+	lcdResetStats(dev);
+	int64_t start = esp_timer_get_time();
+	lcdFillScreen(dev, BLACK);
+	lcdDrawFinish(dev);
+	spi_master_sync(dev);
+	ShowStats(dev, "FillScreen", esp_timer_get_time() - start);
+
+	// Transaction bound
+	lcdResetStats(dev);
+	start = esp_timer_get_time();
+	for(int i=0;i<100;i++) {
+		lcdDrawLine(dev, 0, (i*7)%height, width-1, (i*13)%height, YELLOW);
+	}
+	lcdDrawFinish(dev);
+	spi_master_sync(dev);
+	ShowStats(dev, "DrawLine", esp_timer_get_time() - start);
+
+	// CPU bound
+	lcdResetStats(dev);
+	start = esp_timer_get_time();
+	uint8_t ascii[] = "0123456789";
+	uint8_t buffer[FontxGlyphBufSize];
+	uint8_t fontWidth;
+	uint8_t fontHeight;
+	GetFontx(fx, 0, buffer, &fontWidth, &fontHeight);
+	for(int ypos=fontHeight;ypos<height;ypos+=fontHeight) {
+		lcdDrawString(dev, fx, 0, ypos, ascii, WHITE);
+	}
+	lcdDrawFinish(dev);
+	spi_master_sync(dev);
+	ShowStats(dev, "DrawString", esp_timer_get_time() - start);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+#endif
+
+// Called from the flush task
+void FlushDone(TFT_t * dev, void * arg) {
+	TaskHandle_t task = arg;
+	xTaskNotifyGive(task);
+}
+
+TickType_t AsyncTest(TFT_t * dev, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	// Draw 10 frames, first flushing synchronously, then while the previous frame is sent
+	int64_t elapsed[2];
+	for(int async=0;async<2;async++) {
+		int64_t start = esp_timer_get_time();
+		for(int i=0;i<10;i++) {
+			lcdFillScreen(dev, BLACK);
+			for(int j=0;j<20;j++) {
+				uint8_t red = (i*20+j)*8;
+				uint8_t blue = 255-red;
+				lcdDrawFillCircle(dev, (j*53)%width, (j*29+i*7)%height, 20, rgb565(red, 128, blue));
+			}
+			if (async) {
+				lcdDrawFinishAsync(dev, FlushDone, xTaskGetCurrentTaskHandle());
+			} else {
+				lcdDrawFinish(dev);
+			}
+		}
+		if (async) {
+			// Each callback notifies this task once
+			for(int i=0;i<10;i++) ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+		} else {
+			// With the double frame buffer lcdDrawFinish returns before the frame is sent
+			lcdWaitFlush(dev);
+		}
+		elapsed[async] = esp_timer_get_time() - start;
+	}
+	ESP_LOGI(__FUNCTION__, "10 frames[ms] lcdDrawFinish:%"PRId64" lcdDrawFinishAsync:%"PRId64"%s", elapsed[0]/1000, elapsed[1]/1000,
+		dev->_double ? " (double frame buffer)" : "");
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+
+#if CONFIG_FRAME_BUFFER_INDEXED
+// Color cycling: rotate 16 palette entries, no pixel is drawn again
+TickType_t PaletteTest(TFT_t * dev, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	// The fill gives the palette out again, so the rings get entries next to each other
+	lcdFillScreen(dev, BLACK);
+	uint16_t colors[16];
+	uint8_t first = 0;
+	for(int i=0;i<16;i++) {
+		uint8_t red = i*16;
+		uint8_t blue = 255-red;
+		colors[i] = rgb565(red, 64, blue);
+		uint8_t index = lcdPaletteIndex(dev, colors[i]);
+		if (i == 0) first = index;
+		// The entries must follow each other to be rotated in one call
+		if (index != first + i) {
+			ESP_LOGW(__FUNCTION__, "palette is full");
+			return 0;
+		}
+	}
+	for(int i=0;i<16;i++) {
+		uint16_t r = (width < height ? width : height) / 2 * (16 - i) / 16;
+		lcdDrawFillCircle(dev, width/2, height/2, r, colors[i]);
+	}
+	lcdDrawFinish(dev);
+
+	int64_t start = esp_timer_get_time();
+	for(int frame=0;frame<32;frame++) {
+		uint16_t last = colors[15];
+		memmove(&colors[1], &colors[0], sizeof(uint16_t)*15);
+		colors[0] = last;
+		lcdSetPalette(dev, first, 16, colors);
+		lcdDrawFinish(dev);
+	}
+	lcdWaitFlush(dev);
+	ESP_LOGI(__FUNCTION__, "frame[us]:%"PRId64" palette entries used:%d", (esp_timer_get_time() - start)/32, dev->_palette_count);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+#endif
+
+#if CONFIG_FRAME_BUFFER_MONO || CONFIG_FRAME_BUFFER_INDEXED4
+// A full screen of text, the glyphs are merged into the packed frame buffer a byte at a time
+TickType_t ConsoleTest(TFT_t * dev, FontxFile *fx, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	uint8_t buffer[FontxGlyphBufSize];
+	uint8_t fontWidth;
+	uint8_t fontHeight;
+	GetFontx(fx, 0, buffer, &fontWidth, &fontHeight);
+	uint8_t ascii[64];
+	int columns = width / fontWidth;
+	if (columns > sizeof(ascii)-1) columns = sizeof(ascii)-1;
+
+	lcdFillScreen(dev, BLACK);
+	int64_t start = esp_timer_get_time();
+	int lines = 0;
+	for(int ypos=fontHeight-1;ypos<height;ypos+=fontHeight) {
+		for(int i=0;i<columns;i++) ascii[i] = 0x21 + (lines + i) % 94;
+		ascii[columns] = 0;
+		lcdDrawString(dev, fx, 0, ypos, ascii, WHITE);
+		lines++;
+	}
+	int64_t text = esp_timer_get_time() - start;
+	lcdDrawFinish(dev);
+	lcdWaitFlush(dev);
+	ESP_LOGI(__FUNCTION__, "%d lines text[us]:%"PRId64" total[us]:%"PRId64, lines, text, esp_timer_get_time() - start);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+#endif
+
+#if CONFIG_LCD_LOCK
+static volatile bool sensorRunning;
+
+// Another task drawing a level meter on the same panel
+void SensorTask(void *pvParameters) {
+	TFT_t * dev = pvParameters;
+	int width = dev->_width;
+	for(int i=0;i<50;i++) {
+		int level = (i*37)%width;
+		lcdDrawFillRect(dev, 0, 0, level, 19, GREEN);
+		if (level < width-1) lcdDrawFillRect(dev, level+1, 0, width-1, 19, GRAY);
+		lcdDrawFinishSnapshot(dev);
+		vTaskDelay(2);
+	}
+	sensorRunning = false;
+	vTaskDelete(NULL);
+}
+
+TickType_t LockTest(TFT_t * dev, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	lcdFillScreen(dev, BLACK);
+	lcdDrawFinish(dev);
+
+	// Both tasks draw and flush without waiting for each other
+	sensorRunning = true;
+	xTaskCreate(SensorTask, "SENSOR", 1024*2, dev, uxTaskPriorityGet(NULL), NULL);
+	int count = 0;
+	while(sensorRunning) {
+		uint8_t red = count*16;
+		uint8_t blue = 255-red;
+		uint16_t xpos = (count*53)%width;
+		uint16_t ypos = 40+(count*29)%(height-60);
+		lcdDrawFillCircle(dev, xpos, ypos, 10, rgb565(red, 128, blue));
+		lcdDrawFinishSnapshot(dev);
+		count++;
+		vTaskDelay(1);
+	}
+	ESP_LOGI(__FUNCTION__, "circles drawn while the sensor task was running:%d", count);
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+#endif
+
 void RotateImages(int width, int height, uint16_t *image) {
 	int index1 = 0;
 	int index2 = width * height -1;
@@ -1345,6 +1749,54 @@ TickType_t CursorTest(TFT_t * dev, FontxFile *fx, int width, int height) {
 	return diffTick;
 }
 
+#if CONFIG_LCD_STATS && CONFIG_FRAME_BUFFER_DIRTY
+// Compare the bytes sent with bounding boxes and with tiles on the same workloads
+TickType_t DirtyTest(TFT_t * dev, FontxFile *fx, int width, int height) {
+	TickType_t startTick, endTick, diffTick;
+	startTick = xTaskGetTickCount();
+
+	char *mode_name[] = {"rects", "tiles"};
+	for (int mode=LCD_DIRTY_RECTS;mode<=LCD_DIRTY_TILES;mode++) {
+		lcdSetDirtyMode(dev, mode);
+		lcdDrawFinish(dev);
+
+		lcdResetStats(dev);
+		int64_t start = esp_timer_get_time();
+		WrapArroundTest(dev, width, height);
+		ESP_LOGI(__FUNCTION__, "%s", mode_name[mode]);
+		ShowStats(dev, "WrapArround", esp_timer_get_time() - start);
+
+		lcdResetStats(dev);
+		start = esp_timer_get_time();
+		ImageMoveTest(dev, width, height);
+		ESP_LOGI(__FUNCTION__, "%s", mode_name[mode]);
+		ShowStats(dev, "ImageMove", esp_timer_get_time() - start);
+
+		lcdResetStats(dev);
+		start = esp_timer_get_time();
+		ImageInversionTest(dev, width, height);
+		ESP_LOGI(__FUNCTION__, "%s", mode_name[mode]);
+		ShowStats(dev, "ImageInversion", esp_timer_get_time() - start);
+
+		lcdResetStats(dev);
+		start = esp_timer_get_time();
+		CursorTest(dev, fx, width, height);
+		ESP_LOGI(__FUNCTION__, "%s", mode_name[mode]);
+		ShowStats(dev, "Cursor", esp_timer_get_time() - start);
+	}
+#if CONFIG_DIRTY_TILES
+	lcdSetDirtyMode(dev, LCD_DIRTY_TILES);
+#else
+	lcdSetDirtyMode(dev, LCD_DIRTY_RECTS);
+#endif
+
+	endTick = xTaskGetTickCount();
+	diffTick = endTick - startTick;
+	ESP_LOGI(__FUNCTION__, "elapsed time[ms]:%"PRIu32,diffTick*portTICK_PERIOD_MS);
+	return diffTick;
+}
+#endif
+
 void ST7789(void *pvParameters)
 {
 	// set font file
@@ -1370,6 +1822,9 @@ void ST7789(void *pvParameters)
 	//spi_clock_speed(40000000); // 40MHz
 	//spi_clock_speed(60000000); // 60MHz
 
+	// Send pixel data at a higher clock than commands
+	//spi_pixel_clock_speed(80000000); // 80MHz
+
 	spi_master_init(&dev, CONFIG_MOSI_GPIO, CONFIG_SCLK_GPIO, CONFIG_CS_GPIO, CONFIG_DC_GPIO, CONFIG_RESET_GPIO, CONFIG_BL_GPIO);
 	lcdInit(&dev, CONFIG_WIDTH, CONFIG_HEIGHT, CONFIG_OFFSETX, CONFIG_OFFSETY);
 
@@ -1413,12 +1868,52 @@ void ST7789(void *pvParameters)
 		RoundRectTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
 		WAIT;
 
+		FlushTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
+		WAIT;
+
+		if (dev._use_frame_buffer == true) {
+			PlacementTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
+			WAIT;
+		}
+
+#if CONFIG_LCD_STATS
+		StatsTest(&dev, fx16G, CONFIG_WIDTH, CONFIG_HEIGHT);
+		WAIT;
+#endif
+
+#if CONFIG_LCD_LOCK
+		LockTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
+		WAIT;
+#endif
+
+		if (dev._use_frame_buffer == true) {
+			AsyncTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
+			WAIT;
+		}
+
+#if CONFIG_FRAME_BUFFER_INDEXED
+		if (dev._use_frame_buffer == true) {
+			PaletteTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
+			WAIT;
+		}
+#endif
+
+#if CONFIG_FRAME_BUFFER_MONO || CONFIG_FRAME_BUFFER_INDEXED4
+		if (dev._use_frame_buffer == true) {
+			ConsoleTest(&dev, fx16G, CONFIG_WIDTH, CONFIG_HEIGHT);
+			WAIT;
+		}
+#endif
+
 		if (dev._use_frame_buffer == false) {
 			RectAngleTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
 			WAIT;
 
 			TriangleTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
 			WAIT;
+
+			BurstTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
+			WAIT;
 		}
 
 		if (CONFIG_WIDTH >= 240) {
@@ -1466,10 +1961,16 @@ void ST7789(void *pvParameters)
 		PNGTest(&dev, file, CONFIG_WIDTH, CONFIG_HEIGHT);
 		WAIT;
 
+		ScrollTest(&dev, fx24G, CONFIG_WIDTH, CONFIG_HEIGHT);
+		WAIT;
+
 		if (dev._use_frame_buffer == true) {
 			WrapArroundTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
 			WAIT;
 
+			OriginScrollTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
+			WAIT;
+
 			ImageMoveTest(&dev, CONFIG_WIDTH, CONFIG_HEIGHT);
 			WAIT;
 
@@ -1480,6 +1981,11 @@ void ST7789(void *pvParameters)
 			CursorTest(&dev, fx32G, CONFIG_WIDTH, CONFIG_HEIGHT);
 			WAIT;
 #endif
+
+#if CONFIG_LCD_STATS && CONFIG_FRAME_BUFFER_DIRTY
+			DirtyTest(&dev, fx32G, CONFIG_WIDTH, CONFIG_HEIGHT);
+			WAIT;
+#endif
 		}
 
 		strcpy(file, "/spiffs/qrcode.bmp");